@@ -1,67 +1,170 @@
 #include "CryptoUtil.h"
 
-EnclaveCryptoUtils::EnclaveCryptoUtils(const uint8_t* key_data, size_t key_size) {
+EnclaveCryptoUtils::EnclaveCryptoUtils(const uint8_t* key_data, size_t key_size) : nonce_counter(1) {
     if (key_data == nullptr || key_size != 16) {
         sgx_read_rand((uint8_t*)&key, sizeof(key));
     } else {
         memcpy(&key, key_data, sizeof(key));
     }
+    sgx_read_rand(nonce_prefix, sizeof(nonce_prefix));
+
+    // dummy 密钥 = CMAC(key, 标签)，与 GCM 使用的计数器空间分开
+    static const char label[] = "ringoram-dummy-block";
+    sgx_cmac_128bit_tag_t derived;
+    sgx_rijndael128_cmac_msg((const sgx_cmac_128bit_key_t*)&key,
+                             (const uint8_t*)label, sizeof(label) - 1, &derived);
+    memcpy(&dummy_key, &derived, sizeof(dummy_key));
 }
 
-sgx_status_t EnclaveCryptoUtils::encrypt(const std::vector<uint8_t>& plaintext,
-                                         std::vector<uint8_t>& ciphertext) {
-    if (plaintext.empty()) {
-        ciphertext.clear();
-        return SGX_SUCCESS;
-    }
-
-    uint8_t iv[SGX_AESGCM_IV_SIZE];
-    sgx_status_t ret = sgx_read_rand(iv, sizeof(iv));
-    if (ret != SGX_SUCCESS) return ret;
+sgx_status_t EnclaveCryptoUtils::dummy_ciphertext(uint32_t position, uint32_t offset, uint64_t nonce,
+                                                  uint8_t* out, size_t length) {
+    if (length == 0) return SGX_SUCCESS;
+    if (length > (size_t(1) << 20)) return SGX_ERROR_INVALID_PARAMETER;
+
+    // 计数器块：nonce(8) | position(4) | offset(2) | 块计数(2)
+    uint8_t ctr[16] = { 0 };
+    memcpy(ctr, &nonce, 8);
+    memcpy(ctr + 8, &position, 4);
+    ctr[12] = (uint8_t)(offset >> 8);
+    ctr[13] = (uint8_t)offset;
+
+    // 对全零明文做 CTR 加密即得到密钥流
+    std::vector<uint8_t> zeros(length, 0);
+    return sgx_aes_ctr_encrypt(&dummy_key, zeros.data(), (uint32_t)length, ctr, 16, out);
+}
 
-    size_t ciphertext_size = plaintext.size() + SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE;
-    ciphertext.resize(ciphertext_size);
+void EnclaveCryptoUtils::make_iv(uint64_t counter, uint8_t* iv) const {
+    memcpy(iv, nonce_prefix, sizeof(nonce_prefix));
+    memcpy(iv + sizeof(nonce_prefix), &counter, sizeof(counter));
+}
 
-    memcpy(ciphertext.data(), iv, SGX_AESGCM_IV_SIZE);
+sgx_status_t EnclaveCryptoUtils::encrypt_with_iv(const uint8_t* plaintext, size_t size, uint8_t* out,
+                                                 uint64_t counter, const uint8_t* aad, size_t aad_size) {
+    make_iv(counter, out);
 
     sgx_aes_gcm_128bit_tag_t mac;
-    ret = sgx_rijndael128GCM_encrypt(
+    sgx_status_t ret = sgx_rijndael128GCM_encrypt(
         &key,
-        plaintext.data(), plaintext.size(),
-        ciphertext.data() + SGX_AESGCM_IV_SIZE,
-        iv, SGX_AESGCM_IV_SIZE,
-        nullptr, 0,
+        plaintext, (uint32_t)size,
+        out + SGX_AESGCM_IV_SIZE,
+        out, SGX_AESGCM_IV_SIZE,
+        aad, (uint32_t)aad_size,
         &mac
     );
 
     if (ret != SGX_SUCCESS) return ret;
 
-    memcpy(ciphertext.data() + SGX_AESGCM_IV_SIZE + plaintext.size(), &mac, SGX_AESGCM_MAC_SIZE);
+    memcpy(out + SGX_AESGCM_IV_SIZE + size, &mac, SGX_AESGCM_MAC_SIZE);
     return SGX_SUCCESS;
 }
 
-sgx_status_t EnclaveCryptoUtils::decrypt(const std::vector<uint8_t>& ciphertext,
-                                         std::vector<uint8_t>& plaintext) {
-    if (ciphertext.size() < SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE)
+sgx_status_t EnclaveCryptoUtils::encrypt_to(const uint8_t* plaintext, size_t size, uint8_t* out,
+                                            const uint8_t* aad, size_t aad_size) {
+    if (size == 0) return SGX_SUCCESS;
+    return encrypt_with_iv(plaintext, size, out, nonce_counter.fetch_add(1), aad, aad_size);
+}
+
+sgx_status_t EnclaveCryptoUtils::decrypt_to(const uint8_t* ciphertext, size_t size, uint8_t* out,
+                                            const uint8_t* aad, size_t aad_size) {
+    if (size < kOverhead)
         return SGX_ERROR_INVALID_PARAMETER;
 
-    const uint8_t* iv = ciphertext.data();
-    const uint8_t* enc_data = ciphertext.data() + SGX_AESGCM_IV_SIZE;
-    size_t enc_size = ciphertext.size() - SGX_AESGCM_IV_SIZE - SGX_AESGCM_MAC_SIZE;
+    size_t enc_size = size - kOverhead;
     const sgx_aes_gcm_128bit_tag_t* tag =
-        (const sgx_aes_gcm_128bit_tag_t*)(ciphertext.data() + SGX_AESGCM_IV_SIZE + enc_size);
+        (const sgx_aes_gcm_128bit_tag_t*)(ciphertext + SGX_AESGCM_IV_SIZE + enc_size);
 
-    plaintext.resize(enc_size);
-
-    sgx_status_t ret = sgx_rijndael128GCM_decrypt(
+    return sgx_rijndael128GCM_decrypt(
         &key,
-        enc_data, enc_size,
-        plaintext.data(),
-        iv, SGX_AESGCM_IV_SIZE,
-        nullptr, 0,
+        ciphertext + SGX_AESGCM_IV_SIZE, (uint32_t)enc_size,
+        out,
+        ciphertext, SGX_AESGCM_IV_SIZE,
+        aad, (uint32_t)aad_size,
         tag
     );
+}
+
+sgx_status_t EnclaveCryptoUtils::encrypt_batch(const Item* items, size_t count) {
+    if (count == 0) return SGX_SUCCESS;
+
+    uint64_t first = nonce_counter.fetch_add(count);
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].size == 0) continue;
+        sgx_status_t ret = encrypt_with_iv(items[i].in, items[i].size, items[i].out, first + i);
+        if (ret != SGX_SUCCESS) return ret;
+    }
+    return SGX_SUCCESS;
+}
+
+sgx_status_t EnclaveCryptoUtils::decrypt_batch(const Item* items, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        sgx_status_t ret = decrypt_to(items[i].in, items[i].size, items[i].out);
+        if (ret != SGX_SUCCESS) return ret;
+    }
+    return SGX_SUCCESS;
+}
+
+// 整桶载荷 IV 的前 4 字节，只用于区分用途；唯一性由 nonce 保证
+static const uint8_t kPayloadIvLabel[4] = { 'b', 'k', 't', 0 };
+
+void EnclaveCryptoUtils::make_payload_iv(uint64_t nonce, uint8_t* iv) {
+    memcpy(iv, kPayloadIvLabel, sizeof(kPayloadIvLabel));
+    memcpy(iv + sizeof(kPayloadIvLabel), &nonce, sizeof(nonce));
+}
+
+uint64_t EnclaveCryptoUtils::next_nonce() {
+    return nonce_counter.fetch_add(1);
+}
+
+sgx_status_t EnclaveCryptoUtils::seal_payload(uint64_t nonce, const uint8_t* plaintext, size_t size, uint8_t* out,
+                                              sgx_aes_gcm_128bit_tag_t* tag) {
+    uint8_t iv[SGX_AESGCM_IV_SIZE];
+    make_payload_iv(nonce, iv);
+    return sgx_rijndael128GCM_encrypt(&key, plaintext, (uint32_t)size, out, iv, SGX_AESGCM_IV_SIZE,
+                                      nullptr, 0, tag);
+}
+
+sgx_status_t EnclaveCryptoUtils::open_payload(uint64_t nonce, const uint8_t* ciphertext, size_t size,
+                                              const sgx_aes_gcm_128bit_tag_t* tag, uint8_t* out) {
+    uint8_t iv[SGX_AESGCM_IV_SIZE];
+    make_payload_iv(nonce, iv);
+    return sgx_rijndael128GCM_decrypt(&key, ciphertext, (uint32_t)size, out, iv, SGX_AESGCM_IV_SIZE,
+                                      nullptr, 0, tag);
+}
+
+sgx_status_t EnclaveCryptoUtils::payload_keystream(uint64_t nonce, size_t offset, const uint8_t* in, size_t length,
+                                                   uint8_t* out) {
+    if (length == 0) return SGX_SUCCESS;
+    if (offset % 16 != 0) return SGX_ERROR_INVALID_PARAMETER;
+
+    // GCM 的第一个密钥流块使用计数器 IV | 2（IV | 1 用于标签），之后按低 32 位大端递增
+    uint8_t ctr[16];
+    make_payload_iv(nonce, ctr);
+    uint32_t block = (uint32_t)(2 + offset / 16);
+    ctr[12] = (uint8_t)(block >> 24);
+    ctr[13] = (uint8_t)(block >> 16);
+    ctr[14] = (uint8_t)(block >> 8);
+    ctr[15] = (uint8_t)block;
+    return sgx_aes_ctr_encrypt((const sgx_aes_ctr_128bit_key_t*)&key, in, (uint32_t)length, ctr, 32, out);
+}
+
+sgx_status_t EnclaveCryptoUtils::encrypt(const std::vector<uint8_t>& plaintext,
+                                         std::vector<uint8_t>& ciphertext) {
+    if (plaintext.empty()) {
+        ciphertext.clear();
+        return SGX_SUCCESS;
+    }
+
+    ciphertext.resize(plaintext.size() + kOverhead);
+    return encrypt_to(plaintext.data(), plaintext.size(), ciphertext.data());
+}
+
+sgx_status_t EnclaveCryptoUtils::decrypt(const std::vector<uint8_t>& ciphertext,
+                                         std::vector<uint8_t>& plaintext) {
+    if (ciphertext.size() < kOverhead)
+        return SGX_ERROR_INVALID_PARAMETER;
 
+    plaintext.resize(ciphertext.size() - kOverhead);
+    sgx_status_t ret = decrypt_to(ciphertext.data(), ciphertext.size(), plaintext.data());
     if (ret != SGX_SUCCESS) plaintext.clear();
     return ret;
 }
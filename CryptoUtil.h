@@ -6,6 +6,7 @@
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include <atomic>
 
 // ================================
 // Enclave 内部加解密工具类声明
@@ -13,8 +14,29 @@
 class EnclaveCryptoUtils {
 private:
     sgx_aes_gcm_128bit_key_t key;
+    sgx_aes_ctr_128bit_key_t dummy_key;  // 由主密钥派生，只用于生成 dummy 块
+    // GCM 的 IV = 4 字节随机前缀 | 8 字节计数器。前缀在构造时取一次随机数，之后每次加密只递增计数器，
+    // 同一密钥下 IV 不会重复，热路径上不再调用 sgx_read_rand
+    uint8_t nonce_prefix[4];
+    std::atomic<uint64_t> nonce_counter;
+
+    void make_iv(uint64_t counter, uint8_t* iv) const;
+    static void make_payload_iv(uint64_t nonce, uint8_t* iv);
+    sgx_status_t encrypt_with_iv(const uint8_t* plaintext, size_t size, uint8_t* out, uint64_t counter,
+                                 const uint8_t* aad = nullptr, size_t aad_size = 0);
 
 public:
+    // 每块密文比明文多出的字节数，密文布局为 IV | 密文 | MAC
+    static const size_t kOverhead = SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE;
+
+    // 批量加解密中的一项：in 指向 size 字节的输入，out 由调用方提供
+    // （加密时 size + kOverhead 字节，解密时 size - kOverhead 字节）
+    struct Item {
+        const uint8_t* in;
+        size_t size;
+        uint8_t* out;
+    };
+
     EnclaveCryptoUtils(const uint8_t* key_data, size_t key_size);
 
     // 加密
@@ -25,6 +47,31 @@ public:
     sgx_status_t decrypt(const std::vector<uint8_t>& ciphertext,
                          std::vector<uint8_t>& plaintext);
 
+    // 直接在调用方的缓冲区上加解密，不分配内存；aad 为附加认证数据，解密时必须与加密时一致
+    sgx_status_t encrypt_to(const uint8_t* plaintext, size_t size, uint8_t* out,
+                            const uint8_t* aad = nullptr, size_t aad_size = 0);
+    sgx_status_t decrypt_to(const uint8_t* ciphertext, size_t size, uint8_t* out,
+                            const uint8_t* aad = nullptr, size_t aad_size = 0);
+
+    // 一个桶或一条路径上的所有块一起加解密：加密时一次取得 count 个连续计数器；任一项失败时返回错误
+    sgx_status_t encrypt_batch(const Item* items, size_t count);
+    sgx_status_t decrypt_batch(const Item* items, size_t count);
+
+    // 整桶密封：桶的载荷区作为一个 GCM 消息，IV = 4 字节固定标记 | nonce。
+    // nonce 取自逐块加密所用的同一计数器，因此与任何逐块 IV 都不重复；nonce 从 1 开始，0 表示桶未密封
+    uint64_t next_nonce();
+    sgx_status_t seal_payload(uint64_t nonce, const uint8_t* plaintext, size_t size, uint8_t* out,
+                              sgx_aes_gcm_128bit_tag_t* tag);
+    sgx_status_t open_payload(uint64_t nonce, const uint8_t* ciphertext, size_t size,
+                              const sgx_aes_gcm_128bit_tag_t* tag, uint8_t* out);
+    // 用载荷的 GCM 密钥流处理从 offset（16 的倍数）起的 length 字节：解出单个槽位（不校验标签），
+    // 或对全零输入重新生成 dummy 槽位的密文
+    sgx_status_t payload_keystream(uint64_t nonce, size_t offset, const uint8_t* in, size_t length, uint8_t* out);
+
+    // 由 (桶位置, 槽位, 随机数) 确定性地生成 dummy 块密文，Enclave 可随时重新生成
+    sgx_status_t dummy_ciphertext(uint32_t position, uint32_t offset, uint64_t nonce,
+                                  uint8_t* out, size_t length);
+
     // 工具函数
     static sgx_status_t generate_random_key(std::vector<uint8_t>& key, size_t key_size = 16);
     static sgx_status_t generate_random_iv(std::vector<uint8_t>& iv, size_t iv_size = 16);
@@ -5,9 +5,11 @@
 #include <stack>
 #include <algorithm>
 #include <cmath>
+#include <stdexcept>
 #include "ringoram.h"
 #include "RingoramStorage.h"
 #include "SGXEnclave_t.h"
+#include "drbg.h"
 #include <sgx_trts.h>
 
 
@@ -415,37 +417,53 @@ void IRTree::processInternalNodeWithPath(
         });
 
     // ============ 只加载前几个最有希望的节点 ============
+    // 每轮按还缺的个数取下一组候选，通过路径访问的子节点一次批量读取（共享路径上的桶）
     const int MAX_NODES_TO_LOAD = 2;  
+    bool load_by_path = internal_node->getLevel() < cache_end_level;
     
     int loaded_count = 0;
-    for (const auto& candidate : candidates) {
-        // 如果已经加载够了，停止
-        if (loaded_count >= MAX_NODES_TO_LOAD) {
-            break;
+    size_t next_candidate = 0;
+    while (loaded_count < MAX_NODES_TO_LOAD && next_candidate < candidates.size()) {
+        std::vector<const ChildInfo*> group;
+        while (group.size() < static_cast<size_t>(MAX_NODES_TO_LOAD - loaded_count) &&
+               next_candidate < candidates.size()) {
+            const ChildInfo& candidate = candidates[next_candidate++];
+            // 分数太低的跳过
+            if (candidate.estimated_relevance < 0.5) {  // 阈值可以调整
+                continue;
+            }
+            group.push_back(&candidate);
         }
-        
-        // 分数太低的也跳过
-        if (candidate.estimated_relevance < 0.5) {  // 阈值可以调整
-            continue;
+        if (group.empty()) {
+            break;
         }
 
         // 加载子节点
-        std::shared_ptr<Node> child_node;
-        if (internal_node->getLevel() < cache_end_level) {
-            child_node = accessNodeByPath(candidate.child_path);
-            nodes_visited++;
+        std::vector<std::shared_ptr<Node>> child_nodes;
+        if (load_by_path) {
+            std::vector<int> paths;
+            for (const ChildInfo* candidate : group) {
+                paths.push_back(candidate->child_path);
+            }
+            child_nodes = accessNodesByPaths(paths);
+            nodes_visited += static_cast<int>(group.size());
         } else {
-            child_node = cachedLoadNode(candidate.child_id);
+            for (const ChildInfo* candidate : group) {
+                child_nodes.push_back(cachedLoadNode(candidate->child_id));
+            }
         }
-        
-        if (!child_node) continue;
 
-        // 计算精确相关性
-        double relevance = computeNodeRelevance(child_node, keywords, spatial_scope, alpha);
-        
-        if (relevance > 0) {
-            queue.push(TreeHeapEntry(child_node, candidate.child_path, relevance));
-            loaded_count++;  // 成功加载并加入队列才计数
+        for (size_t i = 0; i < group.size(); i++) {
+            const auto& child_node = child_nodes[i];
+            if (!child_node) continue;
+
+            // 计算精确相关性
+            double relevance = computeNodeRelevance(child_node, keywords, spatial_scope, alpha);
+            
+            if (relevance > 0) {
+                queue.push(TreeHeapEntry(child_node, group[i]->child_path, relevance));
+                loaded_count++;  // 成功加载并加入队列才计数
+            }
         }
     }
 }
@@ -582,16 +600,7 @@ int IRTree::assignPathRecursively(int node_id) {
 
 // 获取随机叶子路径
 int IRTree::getRandomLeafPath() const {
- 
-    uint32_t random_value;
-    sgx_status_t ret = sgx_read_rand((uint8_t*)&random_value, sizeof(random_value));
-    
-    if (ret != SGX_SUCCESS) {
-        ocall_print_string("Warning: sgx_read_rand failed, using fallback");
-        
-    }
-    
-    return (int)(random_value % numLeaves);
+    return (int)Drbg::global().uniform(static_cast<uint32_t>(numLeaves));
 }
 
 
@@ -647,6 +656,34 @@ std::shared_ptr<Node> IRTree::accessNodeByPath(int path) {
 
 
 
+std::vector<std::shared_ptr<Node>> IRTree::accessNodesByPaths(const std::vector<int>& paths) {
+    std::vector<std::shared_ptr<Node>> nodes(paths.size());
+    if (!storage) {
+        PRINT("Storage not available for path access");
+        return nodes;
+    }
+
+    auto ring_oram_storage = std::dynamic_pointer_cast<RingOramStorage>(storage);
+    if (!ring_oram_storage) {
+        PRINT("Storage is not RingOramStorage, cannot use path-based access");
+        return nodes;
+    }
+
+    auto node_data = ring_oram_storage->accessByPaths(paths);
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (node_data[i].empty()) {
+            continue;
+        }
+        nodes[i] = NodeSerializer::deserialize(node_data[i]);
+        if (!nodes[i]) {
+            char msg[256];
+            snprintf(msg,sizeof(msg),"Failed to deserialize node from path %d",paths[i]);
+            PRINT(msg);
+        }
+    }
+    return nodes;
+}
+
 std::vector<TreeHeapEntry> IRTree::search(const Query& query)
 {
     // 委托给参数化搜索方法
@@ -1055,7 +1092,15 @@ void IRTree::buildTreeBottomUp(const std::vector<std::shared_ptr<Document>>& doc
         root_node_id = current_level[0]->getId();
     }
 
+    // 建树期间的写入（路径分配、根路径、下半层节点）先缓存，最后整体批量装入空的 ORAM
+    auto ring_oram_storage = std::dynamic_pointer_cast<RingOramStorage>(storage);
+    if (ring_oram_storage) {
+        ring_oram_storage->beginBulkLoad();
+    }
     initializeRecursivePositionMap();
     flushNodeCache();
+    if (ring_oram_storage && !ring_oram_storage->endBulkLoad()) {
+        throw std::runtime_error("Bulk load of the index failed");
+    }
     PRINT("Bottom-up tree construction completed");
 }
\ No newline at end of file
@@ -182,6 +182,8 @@ public:
      * @return 访问到的节点，如果失败返回nullptr
      */
     std::shared_ptr<Node> accessNodeByPath(int path);
+    // 批量按路径加载节点（一次 ORAM 批量访问），结果与 paths 一一对应，失败的位置为 nullptr
+    std::vector<std::shared_ptr<Node>> accessNodesByPaths(const std::vector<int>& paths);
 
     // ====================================================
     // 存储与序列化接口（通过 StorageInterface 实现）
@@ -297,7 +299,7 @@ public:
     // 树结构优化
     // ====================================================
 
-    /// 底向上构建 IRTree（批量建树）
+    /// 底向上构建 IRTree（批量建树），建好的树未能写入 ORAM 时抛出 runtime_error
     void buildTreeBottomUp(const std::vector<std::shared_ptr<Document>>& documents);
 
     /*pathoram::CommunicationStats getOramStats() const;
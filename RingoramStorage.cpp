@@ -1,14 +1,14 @@
 #include "RingoramStorage.h"
 #include"SGXEnclave_t.h"
 
-RingOramStorage::RingOramStorage(int cap, int block_size)
-    : next_block_id(0), capacity(cap) {
+RingOramStorage::RingOramStorage(int cap, int block_size, int tree_base)
+    : next_block_id(0), capacity(cap), root_path(-1), root_path_block_index(-1), bulk_loading(false) {
 
     char msg[256];
     snprintf(msg,sizeof(msg),"Initializing RingOramStorage with capacity: %d",capacity);
     ocall_print_string(msg);
 
-    oram = std::make_unique<ringoram>(capacity);
+    oram = std::make_unique<ringoram>(capacity, cacheLevel, posMapMode, tree_base);
 
     // 尝试加载已存储的根路径
     loadRootPath();
@@ -29,6 +29,64 @@ int RingOramStorage::getNextBlockId() {
 }
 
 
+std::vector<char> RingOramStorage::writeBlock(int block_id, const std::vector<char>& data) {
+    if (bulk_loading) {
+        bulk_blocks[block_id] = data;
+        return data;
+    }
+    return oram->access(block_id, ringoram::WRITE, data);
+}
+
+std::vector<char> RingOramStorage::readBlock(int block_id) {
+    if (bulk_loading) {
+        // 批量装载期间 ORAM 还是空树：未缓存的块就是空块，不访问 ORAM，以免之后只能逐块写入
+        auto it = bulk_blocks.find(block_id);
+        if (it != bulk_blocks.end()) {
+            return it->second;
+        }
+        return {};
+    }
+    return oram->access(block_id, ringoram::READ, {});
+}
+
+void RingOramStorage::beginBulkLoad() {
+    bulk_loading = true;
+}
+
+bool RingOramStorage::endBulkLoad() {
+    if (!bulk_loading) {
+        return true;
+    }
+    bulk_loading = false;
+
+    std::vector<std::pair<int, std::vector<char>>> blocks;
+    blocks.reserve(bulk_blocks.size());
+    for (auto& entry : bulk_blocks) {
+        blocks.emplace_back(entry.first, std::move(entry.second));
+    }
+    bulk_blocks.clear();
+
+    try {
+        if (oram->can_bulk_load()) {
+            oram->bulk_load(blocks);
+            return true;
+        }
+
+        // ORAM 已被访问过，不能再按空树装载：逐块写入
+        ocall_print_string("ORAM already accessed, bulk load falls back to per-block writes");
+        for (auto& b : blocks) {
+            oram->access(b.first, ringoram::WRITE, std::move(b.second));
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Error bulk loading %zu blocks: %s", blocks.size(), e.what());
+        ocall_print_string(buf);
+        return false;
+    }
+}
+
 bool RingOramStorage::storeNode(int node_id, const std::vector<uint8_t>& data) {
     try {
 
@@ -39,7 +97,7 @@ bool RingOramStorage::storeNode(int node_id, const std::vector<uint8_t>& data) {
 
 
 
-        oram->access(block_id, ringoram::WRITE, data_vec);
+        writeBlock(block_id, data_vec);
 
 
 
@@ -65,7 +123,7 @@ std::vector<uint8_t> RingOramStorage::readNode(int node_id) {
 
         std::vector<char> result_data;
       
-        result_data = oram->access(block_id, ringoram::READ, {});
+        result_data = readBlock(block_id);
 
         if (result_data.empty()) {
             return {};
@@ -91,7 +149,7 @@ bool RingOramStorage::deleteNode(int node_id) {
             // 从ORAM中删除：写入空数据
             std::vector<char> empty_data;
 
-            oram->access(block_id, ringoram::WRITE, empty_data);
+            writeBlock(block_id, empty_data);
 
 
             // 清理映射和缓存
@@ -135,7 +193,7 @@ bool RingOramStorage::storeDocument(int doc_id, const std::vector<uint8_t>& data
 
 
 
-        result = oram->access(block_id, ringoram::WRITE, oram_data);
+        result = writeBlock(block_id, oram_data);
 
 
         return !result.empty();
@@ -167,7 +225,7 @@ std::vector<uint8_t> RingOramStorage::readDocument(int doc_id) {
         std::vector<char> result;
 
 
-        result = oram->access(block_id, ringoram::READ,{});
+        result = readBlock(block_id);
 
 
         if (result.empty()) {
@@ -238,6 +296,40 @@ std::vector<uint8_t> RingOramStorage::accessByPath(int path) {
     }
 }
 
+std::vector<std::vector<uint8_t>> RingOramStorage::accessByPaths(const std::vector<int>& paths) {
+    std::vector<std::vector<uint8_t>> results(paths.size());
+    try {
+        // 路径 -> 节点 ID -> 块号，未映射的路径不参与访问
+        std::vector<ringoram::Request> requests;
+        std::vector<size_t> request_slot;
+        for (size_t i = 0; i < paths.size(); i++) {
+            auto block_it = node_id_to_block.find(getNodeIdByPath(paths[i]));
+            if (getBlockIndexByPath(paths[i]) == -1 || block_it == node_id_to_block.end()) {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "No node mapped to path %d", paths[i]);
+                ocall_print_string(buf);
+                continue;
+            }
+            requests.push_back({block_it->second, ringoram::READ, {}});
+            request_slot.push_back(i);
+        }
+        if (requests.empty()) {
+            return results;
+        }
+
+        std::vector<std::vector<char>> data = oram->accessBatch(requests);
+        for (size_t j = 0; j < data.size(); j++) {
+            results[request_slot[j]].assign(data[j].begin(), data[j].end());
+        }
+    }
+    catch (const std::exception& e) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Error accessing %zu paths: %s", paths.size(), e.what());
+        ocall_print_string(buf);
+    }
+    return results;
+}
+
 // 设置根节点路径
 void RingOramStorage::setRootPath(int path) {
     root_path = path;
@@ -273,7 +365,7 @@ void RingOramStorage::persistRootPath() {
 
         // 存储到ORAM
         std::vector<char> data_vec(root_path_data.begin(), root_path_data.end());
-        oram->access(root_path_block_index, ringoram::WRITE, data_vec);
+        writeBlock(root_path_block_index, data_vec);
 
     }
     catch (const std::exception& e) {
@@ -293,7 +385,7 @@ void RingOramStorage::loadRootPath() {
         }
 
         // 从ORAM读取根路径数据
-        std::vector<char> result_data = oram->access(root_path_block_index, ringoram::READ, {});
+        std::vector<char> result_data = readBlock(root_path_block_index);
         if (result_data.size() >= sizeof(int)) {
             memcpy(&root_path, result_data.data(), sizeof(int));
 
@@ -7,6 +7,7 @@
 #include "CryptoUtil.h"
 #include <memory>
 #include <unordered_map>
+#include <map>
 #include <vector>
 
 
@@ -69,6 +70,21 @@ private:
     /// 块索引到路径的映射  
     std::unordered_map<int, int> block_index_to_path;
 
+    /// 批量装载模式：写入先按块 ID 缓存在 Enclave 内，endBulkLoad 时一次装入 ORAM
+    bool bulk_loading;
+    std::map<int, std::vector<char>> bulk_blocks;
+
+    /**
+     * @brief 写一个块：批量装载模式下只缓存，否则经 ORAM 访问
+     * @return 写入后的块数据
+     */
+    std::vector<char> writeBlock(int block_id, const std::vector<char>& data);
+
+    /**
+     * @brief 读一个块：批量装载模式下先查缓存
+     */
+    std::vector<char> readBlock(int block_id);
+
 public:
     // ==============================
     // 构造与初始化
@@ -79,8 +95,9 @@ public:
      * @param cap ORAM 容量（块数）
      * @param block_size 每个块大小（字节）
      * @param use_recursive 是否使用递归 ORAM 模式
+     * @param tree_base ORAM 树在 Host 存储中的起始桶号
      */
-    RingOramStorage(int cap, int block_size = 1024);
+    RingOramStorage(int cap, int block_size = 1024, int tree_base = 0);
 
 
     // ==============================
@@ -131,6 +148,23 @@ public:
      */
     bool batchStoreNodes(const std::vector<std::pair<int, std::vector<uint8_t>>>& nodes) override;
 
+    // ==============================
+    // 批量装载
+    // ==============================
+
+    /**
+     * @brief 开始批量装载：之后的写入只缓存在 Enclave 内，直到 endBulkLoad；
+     *        期间读取未缓存的块返回空，不访问 ORAM
+     */
+    void beginBulkLoad();
+
+    /**
+     * @brief 结束批量装载：ORAM 尚未被访问过时由 ringoram::bulk_load 直接写出整棵树，
+     *        否则退回逐块访问
+     * @return 是否全部写入成功
+     */
+    bool endBulkLoad();
+
     // ==============================
     // 递归访问支持
     // ==============================
@@ -142,6 +176,13 @@ public:
      */
     std::vector<uint8_t> accessByPath(int path);
 
+    /**
+     * @brief 批量按路径访问节点，一次 ringoram::accessBatch 共享各路径上的桶
+     * @param paths 物理路径列表
+     * @return 与 paths 一一对应的节点数据（未映射的路径为空向量）
+     */
+    std::vector<std::vector<uint8_t>> accessByPaths(const std::vector<int>& paths);
+
     /**
      * @brief 设置根节点路径
      * @param path 根节点路径
@@ -6,9 +6,13 @@
 #include <cstdio>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <cmath>
 #include "CryptoUtil.h"
 #include "NodeSerializer.h"
 #include "ringoram.h" 
+#include "sequencer.h"
+#include "payload_pool.h"
 #include"RingoramStorage.h"
 #include "IRTree.h"
 #include"param.h"
@@ -18,6 +22,8 @@ static int enclave_initialized = 0;
 static sgx_aes_gcm_128bit_key_t master_key;
 static EnclaveCryptoUtils* global_crypto = nullptr;
 static std::unique_ptr<ringoram> g_oram;
+// ecall_oram_access 可被多个 Host 线程并发调用，经定序器合并后访问 g_oram
+static std::unique_ptr<OramSequencer> g_sequencer;
 static std::unique_ptr<IRTree> g_irtree;
 
 
@@ -301,17 +307,85 @@ sgx_status_t ecall_test_crypto() {
 // ORAM ECALL 实现
 // ================================
 
+sgx_status_t ecall_register_staging_buffer(uint8_t* buffer, size_t buffer_size) {
+    if (!enclave_initialized) {
+        return SGX_ERROR_UNEXPECTED;
+    }
+
+    sgx_status_t ret = ringoram::set_staging_buffer(buffer, buffer_size);
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("Rejected staging buffer: must lie outside the enclave and hold one bucket");
+        return ret;
+    }
+
+    char msg[100];
+    snprintf(msg, sizeof(msg), "Staging buffer registered: %zu bytes", buffer_size);
+    ocall_print_string(msg);
+    return SGX_SUCCESS;
+}
+
+sgx_status_t ecall_oram_configure(const uint8_t* config, uint8_t* applied, size_t config_size) {
+    if (!enclave_initialized) {
+        return SGX_ERROR_UNEXPECTED;
+    }
+    if (!config || !applied || config_size != sizeof(OramConfig)) {
+        ocall_print_string("Rejected ORAM config: size mismatch between host and enclave");
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+
+    try {
+        OramConfig requested;
+        memcpy(&requested, config, sizeof(requested));
+
+        // 旧参数下建立的实例不再有效，先执行完它们排队的驱逐
+        ringoram::flush_evictions();
+        g_irtree.reset();
+        g_sequencer.reset();
+        g_oram.reset();
+
+        applyOramConfig(requested);
+        OramConfig current = currentOramConfig();
+        memcpy(applied, &current, sizeof(current));
+
+        char msg[200];
+        snprintf(msg, sizeof(msg), "ORAM configured: %d blocks, L=%d, Z=%d, S=%d, blocksize=%d, cacheLevel=%d",
+                 totalnumRealblock, OramL, realBlockEachbkt, dummyBlockEachbkt, blocksize, cacheLevel);
+        ocall_print_string(msg);
+        return SGX_SUCCESS;
+    } catch (const std::exception& e) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "ORAM configuration rejected: %s", e.what());
+        ocall_print_string(msg);
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+}
+
 sgx_status_t ecall_oram_initialize(int capacity) {
     if (!enclave_initialized || !global_crypto) {
         return SGX_ERROR_UNEXPECTED;
     }
     
     try {
-        // 创建 ORAM 实例
+        // 替换旧实例前报告载荷池的使用情况
+        if (g_oram) {
+            PayloadPool::Stats pool = PayloadPool::global().stats();
+            char stats_msg[200];
+            snprintf(stats_msg, sizeof(stats_msg),
+                     "Payload pool: %llu acquired, %llu released, %llu reused, %llu oversize, %llu free",
+                     (unsigned long long)pool.acquired, (unsigned long long)pool.released,
+                     (unsigned long long)pool.reused, (unsigned long long)pool.oversize,
+                     (unsigned long long)pool.free_slabs);
+            ocall_print_string(stats_msg);
+        }
+
+        // 创建 ORAM 实例：先释放旧实例，它的树顶缓存预算归还后新实例才能使用
+        g_sequencer.reset();
+        g_oram.reset();
         g_oram = std::make_unique<ringoram>(capacity);
         
         // 设置加密工具
         g_oram->enclave_crypto = global_crypto;
+        g_sequencer = std::make_unique<OramSequencer>(*g_oram);
         
         char msg[100];
         snprintf(msg, sizeof(msg), "ORAM initialized with capacity: %d", capacity);
@@ -329,7 +403,7 @@ sgx_status_t ecall_oram_initialize(int capacity) {
 sgx_status_t ecall_oram_access(int operation_type, int block_index,
                               const uint8_t* data, size_t data_size,
                               uint8_t* result, size_t result_size) {
-    if (!g_oram) {
+    if (!g_oram || !g_sequencer) {
         return SGX_ERROR_UNEXPECTED;
     }
     
@@ -352,7 +426,7 @@ sgx_status_t ecall_oram_access(int operation_type, int block_index,
         } 
         
         // 执行 ORAM 访问
-        std::vector<char> result_vec = g_oram->access(block_index, op, data_vec);
+        std::vector<char> result_vec = g_sequencer->access(block_index, op, data_vec);
        
         // 返回结果
         if (result && result_size >= result_vec.size()) {
@@ -374,6 +448,41 @@ sgx_status_t ecall_oram_access(int operation_type, int block_index,
     }
 }
 
+sgx_status_t ecall_oram_eviction_worker() {
+    if (!enclave_initialized) {
+        return SGX_ERROR_UNEXPECTED;
+    }
+
+    try {
+        ocall_print_string("Background eviction worker started");
+        ringoram::eviction_worker();
+        ocall_print_string("Background eviction worker stopped");
+        return SGX_SUCCESS;
+    } catch (const std::exception& e) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "Background eviction worker failed: %s", e.what());
+        ocall_print_string(msg);
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+sgx_status_t ecall_oram_stop_eviction_worker() {
+    ringoram::stop_eviction_worker();
+    return SGX_SUCCESS;
+}
+
+sgx_status_t ecall_oram_flush_evictions() {
+    try {
+        ringoram::flush_evictions();
+        return SGX_SUCCESS;
+    } catch (const std::exception& e) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "Flushing queued evictions failed: %s", e.what());
+        ocall_print_string(msg);
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
 
 sgx_status_t ecall_test_nodeserializer() {
     if (!enclave_initialized) {
@@ -417,6 +526,134 @@ sgx_status_t ecall_test_nodeserializer() {
     }
 }
 
+static std::string test_value(const std::string& tag, int i) {
+    return tag + "-" + std::to_string(i);
+}
+
+// 逐个读回 n 个块，与 test_value(tag, i) 比较
+static bool verify_blocks(ringoram& oram, const std::string& tag, int n) {
+    for (int i = 0; i < n; i++) {
+        vector<char> data = oram.access(i, ringoram::READ, {});
+        if (std::string(data.begin(), data.end()) != test_value(tag, i)) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Storage test FAILED: %s, block %d read back wrong data", tag.c_str(), i);
+            ocall_print_string(msg);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 写入 n 个块（bulk 时一次批量装载，否则逐块 access）后逐个读回
+static bool write_then_verify(ringoram& oram, const std::string& tag, int n, bool bulk = false) {
+    if (bulk) {
+        vector<pair<int, vector<char>>> blocks;
+        for (int i = 0; i < n; i++) {
+            std::string value = test_value(tag, i);
+            blocks.emplace_back(i, vector<char>(value.begin(), value.end()));
+        }
+        oram.bulk_load(blocks);
+    } else {
+        for (int i = 0; i < n; i++) {
+            std::string value = test_value(tag, i);
+            oram.access(i, ringoram::WRITE, vector<char>(value.begin(), value.end()));
+        }
+    }
+    return verify_blocks(oram, tag, n);
+}
+
+// 批量装载 n 个块后逐个读回，之后 ORAM 不再接受批量装载
+static bool check_bulk_load(int posmap_mode, int n, int tree_base) {
+    ringoram oram(n, static_cast<int>(ceil(log2(n))) / 2, posmap_mode, tree_base);
+    oram.enclave_crypto = global_crypto;
+
+    if (!write_then_verify(oram, "bulk-" + std::to_string(posmap_mode), n, true)) {
+        return false;
+    }
+    if (oram.can_bulk_load()) {
+        ocall_print_string("Bulk load test FAILED: ORAM still accepts a bulk load after accesses");
+        return false;
+    }
+    return true;
+}
+
+// 逐块写入 n 个块后读回。压缩位置图再反复访问同一块直到它的 8 位计数器溢出，
+// 同组其余块的叶子随之改变（排队搬移），之后所有块仍须读回原值
+static bool check_position_map(int posmap_mode, int n, int tree_base) {
+    ringoram oram(n, static_cast<int>(ceil(log2(n))) / 2, posmap_mode, tree_base);
+    oram.enclave_crypto = global_crypto;
+
+    std::string tag = "posmap-" + std::to_string(posmap_mode);
+    if (!write_then_verify(oram, tag, n)) {
+        return false;
+    }
+
+    if (posmap_mode == POSMAP_COMPRESSED) {
+        for (int k = 0; k < 300; k++) {
+            oram.access(0, ringoram::READ, {});
+        }
+        if (!verify_blocks(oram, tag, n)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 整桶密封：按打开 bucketSealing 的配置建树（ringoram 在构造时读取该参数，建好后恢复原配置），
+// 逐块写入 n 个块后，翻转 Host 上每个桶中各槽位密文的一个字节（元数据中的标签和摘要不变），
+// 读一个不在 stash 中的块必须被拒绝
+static bool check_sealed_tamper(int n, int tree_base) {
+    OramConfig previous = currentOramConfig();
+    OramConfig sealed = previous;
+    sealed.bucketSealing = 1;
+    applyOramConfig(sealed);
+    std::unique_ptr<ringoram> sealed_oram;
+    try {
+        sealed_oram = std::make_unique<ringoram>(n, 0, POSMAP_FLAT, tree_base);
+    } catch (...) {
+        applyOramConfig(previous);
+        throw;
+    }
+    applyOramConfig(previous);
+
+    ringoram& oram = *sealed_oram;
+    oram.enclave_crypto = global_crypto;
+    if (!write_then_verify(oram, "sealed", n)) {
+        return false;
+    }
+
+    int target = -1;
+    for (int i = 0; i < n && target < 0; i++) {
+        if (!oram.stash.find(i)) {
+            target = i;
+        }
+    }
+    if (target < 0) {
+        ocall_print_string("Sealed tamper test FAILED: every block stayed in the stash");
+        return false;
+    }
+
+    for (int pos = 0; pos < oram.num_bucket; pos++) {
+        bucket bkt = oram.sgx_read_bucket(pos);
+        for (auto& blk : bkt.blocks) {
+            if (blk.GetData().empty()) continue;
+            vector<char> data = blk.TakeData();
+            data[0] ^= 1;
+            blk.SetData(std::move(data));
+        }
+        oram.sgx_write_bucket(pos, bkt);
+        oram.recycle_bucket(bkt);
+    }
+
+    try {
+        oram.access(target, ringoram::READ, {});
+    } catch (const std::exception&) {
+        return true;
+    }
+    ocall_print_string("Sealed tamper test FAILED: a tampered slot was accepted");
+    return false;
+}
+
 sgx_status_t ecall_test_ringoram_storage() {
     if (!enclave_initialized || !g_oram) {
         return SGX_ERROR_UNEXPECTED;
@@ -424,9 +661,18 @@ sgx_status_t ecall_test_ringoram_storage() {
     
     try {
         ocall_print_string("=== Testing RingOramStorage inside Enclave ===");
-        
+
+        // 每棵测试树在主树与位置图树之后各占一段存储（Host 按 storageTestBuckets 预留），不写主 ORAM 的桶
+        int n = storageTestBlocks(totalnumRealblock);
+        int next_base = capacity + posMapTreeBuckets(totalnumRealblock);
+        auto next_region = [&]() {
+            int base = next_base;
+            next_base += oramRegionBuckets(n);
+            return base;
+        };
+
         // 在enclave内创建RingOramStorage实例
-        RingOramStorage storage(1000, 1024); // capacity=1000, block_size=1024
+        RingOramStorage storage(n, 1024, next_region());
         
         // 测试节点存储
         MBR test_mbr({0.0, 0.0}, {5.0, 5.0});
@@ -450,16 +696,41 @@ sgx_status_t ecall_test_ringoram_storage() {
         
         // 验证数据
         auto read_node = NodeSerializer::deserialize(read_data);
-        if (read_node && read_node->getId() == 1) {
-            char msg[100];
-            snprintf(msg, sizeof(msg), "RingOramStorage test PASSED, stored nodes: %d", 
-                    storage.getStoredNodeCount());
-            ocall_print_string(msg);
-            return SGX_SUCCESS;
-        } else {
+        if (!read_node || read_node->getId() != 1) {
             ocall_print_string("RingOramStorage test FAILED - data corruption");
             return SGX_ERROR_UNEXPECTED;
         }
+        char msg[100];
+        snprintf(msg, sizeof(msg), "RingOramStorage test PASSED, stored nodes: %d", 
+                storage.getStoredNodeCount());
+        ocall_print_string(msg);
+
+        // 批量装载与各位置图、整桶密封的校验
+        for (int mode : {POSMAP_FLAT, POSMAP_RECURSIVE, POSMAP_COMPRESSED}) {
+            if (!check_bulk_load(mode, n, next_region())) {
+                return SGX_ERROR_UNEXPECTED;
+            }
+        }
+        ocall_print_string("Bulk load test PASSED for flat, recursive and compressed position maps");
+
+        for (int mode : {POSMAP_RECURSIVE, POSMAP_COMPRESSED}) {
+            if (!check_position_map(mode, n, next_region())) {
+                return SGX_ERROR_UNEXPECTED;
+            }
+        }
+        ocall_print_string("Position map test PASSED for recursive and compressed position maps");
+
+        OramConfig sealed = currentOramConfig();
+        sealed.bucketSealing = 1;
+        if (!bucketFitsLimits(sealed)) {
+            ocall_print_string("Sealed metadata does not fit this bucket geometry, tamper test skipped");
+            return SGX_SUCCESS;
+        }
+        if (!check_sealed_tamper(std::min(n, 64), next_region())) {
+            return SGX_ERROR_UNEXPECTED;
+        }
+        ocall_print_string("Sealed bucket tamper test PASSED");
+        return SGX_SUCCESS;
         
     } catch (const std::exception& e) {
         char msg[200];
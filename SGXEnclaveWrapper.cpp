@@ -1,5 +1,6 @@
 #include "SGXEnclaveWrapper.h"
 #include "SGXEnclave_u.h"
+#include <sgx_uswitchless.h>
 #include "ringoram.h"
 #include "ServerStorage.h"
 #include "param.h"
@@ -9,6 +10,13 @@
 #include <memory>
 #include <fstream>
 #include <chrono>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <condition_variable>
+#include <climits>
 
 using namespace std;
 
@@ -16,187 +24,98 @@ using namespace std;
 // 全局外部存储实例
 static std::unique_ptr<ServerStorage> g_external_storage;
 
-// 静态变量用于时间测量
-static std::chrono::high_resolution_clock::time_point g_measurement_start;
+// 在 ecall_register_staging_buffer 中注册给 Enclave 的不可信暂存区
+static std::vector<uint8_t> g_staging_buffer;
 
-// OCALL实现 - 在飞地外执行
-extern "C" void ocall_print_string(const char* str) {
-    std::cout << "[ENCLAVE OCALL]: " << str << std::endl;
-}
+// 驱逐路径预取线程：ocall_prefetch_paths 把下一批驱逐路径的桶号放入队列即返回，
+// 线程在前台查询期间调用 ServerStorage::PrefetchBucket。只在 LAYOUT_MMAP 下运行，
+// 更换外部存储前先停止，因此线程访问 g_external_storage 时无需加锁
+static std::mutex g_prefetch_mutex;
+static std::condition_variable g_prefetch_cv;
+static std::deque<int> g_prefetch_queue;
+static bool g_prefetch_running = false;
+static bool g_prefetch_stop = false;
+static std::thread g_prefetch_thread;
+static uint64_t g_prefetched_buckets = 0;
+// 队列上限（桶数），超出时丢弃最早的提示
+static const size_t kMaxPrefetchQueue = 4096;
 
+static void prefetch_worker() {
+    std::unique_lock<std::mutex> lock(g_prefetch_mutex);
+    while (true) {
+        g_prefetch_cv.wait(lock, [] { return g_prefetch_stop || !g_prefetch_queue.empty(); });
+        if (g_prefetch_stop) {
+            return;
+        }
+        std::deque<int> positions;
+        positions.swap(g_prefetch_queue);
+        lock.unlock();
 
-// ================================
-// 序列化工具函数
-// ================================
+        for (int position : positions) {
+            g_external_storage->PrefetchBucket(position);
+        }
 
-size_t calculate_bucket_size(const bucket& bkt) {
-    
-    size_t size = sizeof(SerializedBucketHeader);
-    
-    // 计算blocks大小
-    size_t blocks_size = 0;
-    for (int i = 0; i < bkt.blocks.size(); i++) {
-        const auto& blk = bkt.blocks[i];
-        size_t block_size = sizeof(SerializedBlockHeader) + blk.GetData().size();
-        blocks_size += block_size;
-      
+        lock.lock();
+        g_prefetched_buckets += positions.size();
     }
-    size += blocks_size;
-    
-    // 计算ptrs和valids大小
-    size_t ptrs_valids_size = (bkt.ptrs.size() + bkt.valids.size()) * sizeof(int32_t);
-    size += ptrs_valids_size;
- 
-    return size;
 }
 
-void serialize_block(const block& blk, uint8_t* buffer, size_t& offset) {
-  
-    SerializedBlockHeader* header = reinterpret_cast<SerializedBlockHeader*>(buffer + offset);
-    header->leaf_id = blk.GetLeafid();
-    header->block_index = blk.GetBlockindex();
-    
-    const auto& data = blk.GetData();
-    header->data_size = static_cast<int32_t>(data.size());
- 
-    offset += sizeof(SerializedBlockHeader);
-    
-    if (!data.empty()) {
-        memcpy(buffer + offset, data.data(), data.size());
-        offset += data.size();
+static void start_path_prefetcher() {
+    std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+    if (g_prefetch_running) {
+        return;
     }
-
+    g_prefetch_stop = false;
+    g_prefetch_running = true;
+    g_prefetch_thread = std::thread(prefetch_worker);
 }
 
-block deserialize_block(const uint8_t* data, size_t& offset) {
-    const SerializedBlockHeader* header = reinterpret_cast<const SerializedBlockHeader*>(data + offset);
-    offset += sizeof(SerializedBlockHeader);
-    
-    std::vector<char> block_data;
-    if (header->data_size > 0) {
-        block_data.resize(header->data_size);
-        memcpy(block_data.data(), data + offset, header->data_size);
-        offset += header->data_size;
+static void stop_path_prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+        if (!g_prefetch_running) {
+            return;
+        }
+        g_prefetch_stop = true;
+        g_prefetch_running = false;
+        g_prefetch_queue.clear();
+    }
+    g_prefetch_cv.notify_all();
+    g_prefetch_thread.join();
+    if (g_prefetched_buckets > 0) {
+        std::cout << "Eviction path prefetch: " << g_prefetched_buckets << " buckets" << std::endl;
+        g_prefetched_buckets = 0;
     }
-    
-    return block(header->leaf_id, header->block_index, block_data);
 }
 
-std::vector<uint8_t> serialize_bucket(const bucket& bkt) {
-   
-    try {
-    
-        // 先计算大小
+// 静态变量用于时间测量
+static std::chrono::high_resolution_clock::time_point g_measurement_start;
 
-        size_t total_size = calculate_bucket_size(bkt);
-     
-        if (total_size == 0) {
-            std::cerr << "ERROR: Calculated size is 0" << std::endl;
-            return std::vector<uint8_t>();
-        }
-       
-        std::vector<uint8_t> result(total_size);
-      
-        // 序列化 bucket header
-      
-        SerializedBucketHeader* bucket_header = reinterpret_cast<SerializedBucketHeader*>(result.data());
-        bucket_header->Z = bkt.Z;
-        bucket_header->S = bkt.S;
-        bucket_header->count = bkt.count;
-        bucket_header->num_blocks = static_cast<int32_t>(bkt.blocks.size());
-       
-        size_t offset = sizeof(SerializedBucketHeader);
-       
-        // 序列化 blocks
-    
-        for (int i = 0; i < bkt.blocks.size(); i++) {
-          
-            serialize_block(bkt.blocks[i], result.data(), offset);
-       
-        }
-        
-        // 序列化 ptrs 和 valids
-   
-        int num_slots = bkt.Z + bkt.S;
- 
-        // 检查边界
-        if (offset + num_slots * 2 * sizeof(int32_t) > total_size) {
-            std::cerr << "ERROR: Not enough space for ptrs and valids" << std::endl;
-            return std::vector<uint8_t>();
-        }
-        
-        // 序列化 ptrs
-        for (int i = 0; i < num_slots; i++) {
-            *reinterpret_cast<int32_t*>(result.data() + offset) = bkt.ptrs[i];
-            offset += sizeof(int32_t);
-        }
-        
-        // 序列化 valids
-        for (int i = 0; i < num_slots; i++) {
-            *reinterpret_cast<int32_t*>(result.data() + offset) = bkt.valids[i];
-            offset += sizeof(int32_t);
-        }
- 
-        return result;
-        
-    } catch (const std::exception& e) {
-        std::cerr << "serialize_bucket failed with exception: " << e.what() << std::endl;
-        return std::vector<uint8_t>();
-    }
-}
+// switchless worker 的统计，按 worker 线程记录最近一次回调给出的累计值
+static std::mutex g_switchless_mutex;
+static std::map<std::thread::id, sgx_uswitchless_worker_stats_t> g_switchless_worker_stats;
+static uint64_t g_switchless_miss_events = 0;
 
-bucket deserialize_bucket(const uint8_t* data, size_t size) {
- 
-    if (size < sizeof(SerializedBucketHeader)) {
-        std::cerr << "  ERROR: Data too small for header" << std::endl;
-        throw std::runtime_error("Invalid bucket data: too small");
-    }
-    
-    const SerializedBucketHeader* bucket_header = reinterpret_cast<const SerializedBucketHeader*>(data);
-  
-    // 创建空的bucket
-    bucket result(0, 0);
-    result.Z = bucket_header->Z;
-    result.S = bucket_header->S;
-    result.count = bucket_header->count;
-    
-    size_t offset = sizeof(SerializedBucketHeader);
- 
-    // 反序列化 blocks
-  
-    for (int i = 0; i < bucket_header->num_blocks && offset < size; i++) {
-        result.blocks.push_back(deserialize_block(data, offset));
+static void on_switchless_worker_event(sgx_uswitchless_worker_type_t type,
+                                       sgx_uswitchless_worker_event_t event,
+                                       const sgx_uswitchless_worker_stats_t* stats) {
+    if (type != SGX_USWITCHLESS_WORKER_TYPE_UNTRUSTED || !stats) {
+        return;
     }
- 
-    //从序列化数据中恢复ptrs和valids
-    int num_slots = result.Z + result.S;
-    result.ptrs.resize(num_slots, -1);
-    result.valids.resize(num_slots, 0);
-    
-    // 检查是否有足够的空间来读取ptrs和valids
-    if (offset + num_slots * 2 * sizeof(int32_t) <= size) {
-     
-        // 反序列化 ptrs
-        for (int i = 0; i < num_slots; i++) {
-            int32_t ptr = *reinterpret_cast<const int32_t*>(data + offset);
-            result.ptrs[i] = ptr;
-            offset += sizeof(int32_t);
-        }
-        
-        // 反序列化 valids
-        for (int i = 0; i < num_slots; i++) {
-            int32_t valid = *reinterpret_cast<const int32_t*>(data + offset);
-            result.valids[i] = valid;
-            offset += sizeof(int32_t);
-        }
-   
-    } else {
-        std::cout << "  WARNING: No ptrs and valids data in serialized bucket" << std::endl;
+
+    std::lock_guard<std::mutex> lock(g_switchless_mutex);
+    g_switchless_worker_stats[std::this_thread::get_id()] = *stats;
+    if (event == SGX_USWITCHLESS_WORKER_EVENT_MISS) {
+        g_switchless_miss_events++;
     }
-   
-    return result;
 }
 
+// OCALL实现 - 在飞地外执行
+extern "C" void ocall_print_string(const char* str) {
+    std::cout << "[ENCLAVE OCALL]: " << str << std::endl;
+}
+
+
 void checkServerStorageState(int position, const std::string& context) {
     if (!g_external_storage) {
         std::cout << "[" << context << "] ServerStorage not initialized" << std::endl;
@@ -213,7 +132,7 @@ void checkServerStorageState(int position, const std::string& context) {
             const auto& blk = stored_bucket.blocks[i];
             if (blk.GetBlockindex() != -1) {
                 real_blocks++;
-                std::vector<char> data = blk.GetData();
+                const std::vector<char>& data = blk.GetData();
                 std::string data_str(data.begin(), data.end());
                 std::cout << "  REAL Block " << i << ": index=" << blk.GetBlockindex() 
                           << ", data_size=" << data.size();
@@ -235,7 +154,10 @@ void checkServerStorageState(int position, const std::string& context) {
 
 extern "C" sgx_status_t ocall_read_bucket(
     int position,  // 位置指针
-    uint8_t* data) {
+    size_t* actual_size,
+    uint8_t* metadata,
+    size_t meta_capacity,
+    size_t* meta_size) {
     
  
     try {
@@ -252,16 +174,9 @@ extern "C" sgx_status_t ocall_read_bucket(
             return SGX_ERROR_INVALID_PARAMETER;
         }
         
-        bucket bkt = g_external_storage->GetBucket(actual_position);
-        std::vector<uint8_t> serialized = serialize_bucket(bkt);
-        
-        const size_t BUFFER_SIZE = 65536;
-        if (serialized.size() > BUFFER_SIZE) {
-            std::cerr << "ERROR: Serialized data too large" << std::endl;
-            return SGX_ERROR_INVALID_PARAMETER;
-        }
-        
-        memcpy(data, serialized.data(), serialized.size());
+        // 桶字节直接写入暂存区，平坦布局下就是一次 memcpy
+        *actual_size = g_external_storage->ReadBucketBytes(actual_position, g_staging_buffer.data(), g_staging_buffer.size());
+        *meta_size = g_external_storage->ReadMetadata(actual_position, metadata, meta_capacity);
  
         return SGX_SUCCESS;
         
@@ -271,7 +186,8 @@ extern "C" sgx_status_t ocall_read_bucket(
     }
 }
 
-extern "C" sgx_status_t ocall_write_bucket(int position, const uint8_t* data) {
+extern "C" sgx_status_t ocall_write_bucket(int position, size_t data_size,
+                                           const uint8_t* metadata, size_t meta_size) {
     
     
     try {
@@ -280,21 +196,17 @@ extern "C" sgx_status_t ocall_write_bucket(int position, const uint8_t* data) {
             return SGX_ERROR_UNEXPECTED;
         }
         
-        // 反序列化要写入的数据
-        bucket bkt_to_write = deserialize_bucket(data, 65536);
-        
-        // 检查要写入的块
-        int real_blocks_to_write = 0;
-        for (int i = 0; i < bkt_to_write.blocks.size(); i++) {
-            const auto& blk = bkt_to_write.blocks[i];
-            if (blk.GetBlockindex() != -1) {
-                real_blocks_to_write++;
-               
-            }
+        // Enclave 已将序列化的桶写入暂存区，校验声明的长度与块头一致
+        if (data_size > g_staging_buffer.size() ||
+            serialized_bucket_length(g_staging_buffer.data(), data_size) != data_size ||
+            meta_size > MAX_BUCKET_METADATA_SIZE) {
+            std::cerr << "ERROR: Malformed bucket data for position " << position << std::endl;
+            return SGX_ERROR_INVALID_PARAMETER;
         }
  
         // 执行写入
-        g_external_storage->SetBucket(position, bkt_to_write);
+        g_external_storage->WriteBucketBytes(position, g_staging_buffer.data(), data_size);
+        g_external_storage->WriteMetadata(position, metadata, meta_size);
   
         return SGX_SUCCESS;
         
@@ -304,85 +216,436 @@ extern "C" sgx_status_t ocall_write_bucket(int position, const uint8_t* data) {
     }
 }
 
+// 校验整条路径请求：树的起始位置、叶子、层数、暂存区以及元数据缓冲区的容量
+static bool check_path_request(int tree_base, int leafid, int levels, size_t meta_buf_size) {
+    if (!g_external_storage) {
+        std::cerr << "ERROR: External storage not initialized" << std::endl;
+        return false;
+    }
+    if (levels <= 0 || levels > 31 ||
+        static_cast<size_t>(levels) * MAX_SERIALIZED_BUCKET_SIZE > g_staging_buffer.size() ||
+        static_cast<size_t>(levels) * MAX_BUCKET_METADATA_SIZE > meta_buf_size) {
+        std::cerr << "ERROR: Invalid path length: " << levels << std::endl;
+        return false;
+    }
+    if (leafid < 0 || leafid >= (1LL << (levels - 1)) || tree_base < 0 ||
+        static_cast<long long>(tree_base) + (1LL << levels) - 1 > g_external_storage->GetCapacity()) {
+        std::cerr << "ERROR: Invalid path leaf: " << leafid << " (tree base " << tree_base << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 路径上第 level 层桶的位置（levels = L + 1），tree_base 为该树的起始桶号
+static int path_bucket_position(int tree_base, int leafid, int level, int levels) {
+    return tree_base + (1 << level) - 1 + (leafid >> (levels - 1 - level));
+}
 
-extern "C" sgx_status_t ocall_read_path(
+extern "C" sgx_status_t ocall_read_path_metadata(
+    int tree_base,
     int leafid,
-    int blockindex,
-    int* is_dummy,
-    uint8_t* result_data,
-    size_t* actual_size) {
-    
+    int levels,
+    int first_level,
+    uint8_t* metadata,
+    size_t meta_buf_size,
+    size_t* meta_sizes) {
+
     try {
-        if (!g_external_storage) {
-            std::cerr << "ERROR: External storage not initialized" << std::endl;
-            return SGX_ERROR_UNEXPECTED;
+        if (!check_path_request(tree_base, leafid, levels, meta_buf_size) || first_level < 0 || first_level > levels) {
+            return SGX_ERROR_INVALID_PARAMETER;
         }
-        
-        int L = OramL;
-        int capacity = g_external_storage->GetCapacity();
-  
-        block interestblock = dummyBlock;
-        
-        // 遍历路径上的所有层级
-        for (int i = 0; i <= L; i++) {
-            int position = (1 << i) - 1 + (leafid >> (L - i));
-   
-            if (position < 0 || position >= capacity) {
-                std::cerr << "ERROR: Invalid bucket position: " << position 
-                    << " (leafid=" << leafid << ", level=" << i 
-                    << ", capacity=" << capacity << ")" 
-                    << std::endl;
-                position = 0;
+
+        for (int i = 0; i < levels; i++) {
+            if (i < first_level) {
+                meta_sizes[i] = 0;
+                continue;
             }
-            
-            bucket& bkt = g_external_storage->GetBucket(position);
-            
-            // 查找目标块
-            int offset = -1;
-            for (int j = 0; j < (realBlockEachbkt + dummyBlockEachbkt); j++) {
-                if (bkt.ptrs[j] == blockindex && bkt.valids[j] == 1) {
-                    offset = j;
-                    break;
-                }
+            meta_sizes[i] = g_external_storage->ReadMetadata(path_bucket_position(tree_base, leafid, i, levels),
+                metadata + i * MAX_BUCKET_METADATA_SIZE, MAX_BUCKET_METADATA_SIZE);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_path_metadata: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+// 校验路径读取中 Enclave 给出的每层偏移和元数据长度
+static bool check_path_offsets(int levels, int first_level, const int* offsets, const size_t* meta_sizes) {
+    for (int i = first_level; i < levels; i++) {
+        if (offsets[i] < 0 || offsets[i] >= maxblockEachbkt) {
+            std::cerr << "ERROR: Invalid slot offset for path level " << i << ": " << offsets[i] << std::endl;
+            return false;
+        }
+        if (meta_sizes[i] > MAX_BUCKET_METADATA_SIZE) {
+            std::cerr << "ERROR: Oversized metadata for path level " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+extern "C" sgx_status_t ocall_read_path_blocks(
+    int tree_base,
+    int leafid,
+    int levels,
+    int first_level,
+    const int* offsets,
+    const uint8_t* metadata,
+    size_t meta_buf_size,
+    const size_t* meta_sizes,
+    size_t* block_sizes) {
+
+    try {
+        if (!check_path_request(tree_base, leafid, levels, meta_buf_size) || first_level < 0 || first_level > levels) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+        if (!check_path_offsets(levels, first_level, offsets, meta_sizes)) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // Host 不解析元数据，只按 Enclave 给出的偏移取块；所有层都读成功后才写回元数据，
+        // 中途失败时 Host 上的桶保持原样
+        for (int i = 0; i < levels; i++) {
+            if (i < first_level) {
+                block_sizes[i] = 0;
+                continue;
             }
-            
-            if (offset == -1) {
-                offset = bkt.GetDummyblockOffset();
-            } 
-            
-            block blk = bkt.blocks[offset];
-            
-            // 标记为无效
-            bkt.valids[offset] = 0;
-            bkt.count += 1;
-            
-            if (blk.GetBlockindex() == blockindex) {
-                interestblock = blk;
-                break;
+            int position = path_bucket_position(tree_base, leafid, i, levels);
+            uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            block_sizes[i] = g_external_storage->ReadBlockBytes(position, offsets[i], slot, MAX_SERIALIZED_BUCKET_SIZE);
+        }
+        for (int i = first_level; i < levels; i++) {
+            g_external_storage->WriteMetadata(path_bucket_position(tree_base, leafid, i, levels),
+                                              metadata + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_path_blocks: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+// 校验批量请求中的桶列表：位置在该树范围内，元数据缓冲区足够
+static bool check_bucket_request(int tree_base, int num_buckets, const int* positions, size_t meta_buf_size) {
+    if (!g_external_storage) {
+        std::cerr << "ERROR: External storage not initialized" << std::endl;
+        return false;
+    }
+    if (num_buckets <= 0 || tree_base < 0 ||
+        static_cast<size_t>(num_buckets) * MAX_BUCKET_METADATA_SIZE > meta_buf_size) {
+        std::cerr << "ERROR: Invalid bucket batch: " << num_buckets << std::endl;
+        return false;
+    }
+    for (int i = 0; i < num_buckets; i++) {
+        if (positions[i] < 0 || static_cast<long long>(tree_base) + positions[i] >= g_external_storage->GetCapacity()) {
+            std::cerr << "ERROR: Invalid bucket position in batch: " << positions[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+extern "C" sgx_status_t ocall_read_buckets_metadata(
+    int tree_base,
+    int num_buckets,
+    const int* positions,
+    uint8_t* metadata,
+    size_t meta_buf_size,
+    size_t* meta_sizes) {
+
+    try {
+        if (!check_bucket_request(tree_base, num_buckets, positions, meta_buf_size)) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < num_buckets; i++) {
+            meta_sizes[i] = g_external_storage->ReadMetadata(tree_base + positions[i],
+                metadata + i * MAX_BUCKET_METADATA_SIZE, MAX_BUCKET_METADATA_SIZE);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_buckets_metadata: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+extern "C" sgx_status_t ocall_read_blocks(
+    int tree_base,
+    int num_buckets,
+    const int* positions,
+    const uint8_t* metadata,
+    size_t meta_buf_size,
+    const size_t* meta_sizes,
+    int num_reads,
+    const int* read_buckets,
+    const int* read_offsets,
+    size_t* block_sizes) {
+
+    try {
+        if (!check_bucket_request(tree_base, num_buckets, positions, meta_buf_size) || num_reads < 0) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < num_buckets; i++) {
+            if (meta_sizes[i] > MAX_BUCKET_METADATA_SIZE) {
+                std::cerr << "ERROR: Oversized metadata for batched bucket " << i << std::endl;
+                return SGX_ERROR_INVALID_PARAMETER;
             }
         }
-        
-        // 判断是否是dummy块
-        *is_dummy = (interestblock.GetBlockindex() == -1) ? 1 : 0;
-
-        const auto& data = interestblock.GetData();
-        if (!data.empty() && result_data) {
-            if (data.size() > 65536) {
-                std::cerr << "ERROR: Block data size " << data.size() 
-                  << " exceeds maximum blocksize" << std::endl;
+
+        // 先把所有块紧密排列到暂存区，放不下时不做任何修改，Enclave 会改为逐条路径读取
+        std::vector<uint8_t> block(MAX_SERIALIZED_BUCKET_SIZE);
+        size_t used = 0;
+        for (int j = 0; j < num_reads; j++) {
+            if (read_buckets[j] < 0 || read_buckets[j] >= num_buckets) {
                 return SGX_ERROR_INVALID_PARAMETER;
             }
-            memcpy(result_data, data.data(), data.size());
-            *actual_size = data.size(); 
-        } 
+            size_t size = g_external_storage->ReadBlockBytes(tree_base + positions[read_buckets[j]], read_offsets[j],
+                                                             block.data(), block.size());
+            if (size > g_staging_buffer.size() - used) {
+                return SGX_ERROR_OUT_OF_MEMORY;
+            }
+            memcpy(g_staging_buffer.data() + used, block.data(), size);
+            block_sizes[j] = size;
+            used += size;
+        }
+
+        for (int i = 0; i < num_buckets; i++) {
+            g_external_storage->WriteMetadata(tree_base + positions[i], metadata + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+        }
         return SGX_SUCCESS;
-        
+
     } catch (const std::exception& e) {
-        std::cerr << "Exception in ocall_read_path: " << e.what() << std::endl;
+        std::cerr << "Exception in ocall_read_blocks: " << e.what() << std::endl;
         return SGX_ERROR_UNEXPECTED;
     }
 }
 
+extern "C" sgx_status_t ocall_read_path_xor(
+    int tree_base,
+    int leafid,
+    int levels,
+    int first_level,
+    const int* offsets,
+    const uint8_t* metadata,
+    size_t meta_buf_size,
+    const size_t* meta_sizes,
+    size_t* block_sizes,
+    size_t* xor_size) {
+
+    try {
+        if (!check_path_request(tree_base, leafid, levels, meta_buf_size) || first_level < 0 || first_level > levels) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+        if (!check_path_offsets(levels, first_level, offsets, meta_sizes)) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // 各层选中的块逐字节异或到暂存区开头，长度取最长的块；全部异或完成后才写回元数据
+        uint8_t* acc = g_staging_buffer.data();
+        memset(acc, 0, MAX_SERIALIZED_BUCKET_SIZE);
+        *xor_size = 0;
+        for (int i = 0; i < levels; i++) {
+            if (i < first_level) {
+                block_sizes[i] = 0;
+                continue;
+            }
+            int position = path_bucket_position(tree_base, leafid, i, levels);
+            block_sizes[i] = g_external_storage->XorBlockBytes(position, offsets[i], acc, MAX_SERIALIZED_BUCKET_SIZE);
+            *xor_size = std::max(*xor_size, block_sizes[i]);
+        }
+        for (int i = first_level; i < levels; i++) {
+            g_external_storage->WriteMetadata(path_bucket_position(tree_base, leafid, i, levels),
+                                              metadata + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_path_xor: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+extern "C" sgx_status_t ocall_read_path_buckets(
+    int tree_base,
+    int leafid,
+    int levels,
+    const uint8_t* wanted,
+    size_t* actual_sizes,
+    uint8_t* metadata,
+    size_t meta_buf_size,
+    size_t* meta_sizes) {
+
+    try {
+        if (!check_path_request(tree_base, leafid, levels, meta_buf_size)) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // 第 i 层桶写入暂存区的第 i 个槽
+        for (int i = 0; i < levels; i++) {
+            if (!wanted[i]) {
+                actual_sizes[i] = 0;
+                meta_sizes[i] = 0;
+                continue;
+            }
+            int position = path_bucket_position(tree_base, leafid, i, levels);
+            uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            actual_sizes[i] = g_external_storage->ReadBucketBytes(position, slot, MAX_SERIALIZED_BUCKET_SIZE);
+            meta_sizes[i] = g_external_storage->ReadMetadata(position,
+                metadata + i * MAX_BUCKET_METADATA_SIZE, MAX_BUCKET_METADATA_SIZE);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_path_buckets: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+extern "C" sgx_status_t ocall_read_buckets(
+    int tree_base,
+    int num_buckets,
+    const int* positions,
+    size_t* actual_sizes,
+    uint8_t* metadata,
+    size_t meta_buf_size,
+    size_t* meta_sizes) {
+
+    try {
+        if (!check_bucket_request(tree_base, num_buckets, positions, meta_buf_size) ||
+            static_cast<size_t>(num_buckets) * MAX_SERIALIZED_BUCKET_SIZE > g_staging_buffer.size()) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // 第 i 个桶写入暂存区的第 i 个槽
+        for (int i = 0; i < num_buckets; i++) {
+            int position = tree_base + positions[i];
+            uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            actual_sizes[i] = g_external_storage->ReadBucketBytes(position, slot, MAX_SERIALIZED_BUCKET_SIZE);
+            meta_sizes[i] = g_external_storage->ReadMetadata(position,
+                metadata + i * MAX_BUCKET_METADATA_SIZE, MAX_BUCKET_METADATA_SIZE);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_read_buckets: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+extern "C" sgx_status_t ocall_write_buckets(
+    int tree_base,
+    int num_buckets,
+    const int* positions,
+    const size_t* data_sizes,
+    const uint8_t* metadata,
+    size_t meta_buf_size,
+    const size_t* meta_sizes) {
+
+    try {
+        if (!check_bucket_request(tree_base, num_buckets, positions, meta_buf_size) ||
+            static_cast<size_t>(num_buckets) * MAX_SERIALIZED_BUCKET_SIZE > g_staging_buffer.size()) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // 先校验所有桶，避免只写入一部分
+        for (int i = 0; i < num_buckets; i++) {
+            const uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            if (data_sizes[i] > MAX_SERIALIZED_BUCKET_SIZE ||
+                serialized_bucket_length(slot, data_sizes[i]) != data_sizes[i] ||
+                meta_sizes[i] > MAX_BUCKET_METADATA_SIZE) {
+                std::cerr << "ERROR: Malformed bucket data for batched bucket " << i << std::endl;
+                return SGX_ERROR_INVALID_PARAMETER;
+            }
+        }
+
+        for (int i = 0; i < num_buckets; i++) {
+            int position = tree_base + positions[i];
+            const uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            g_external_storage->WriteBucketBytes(position, slot, data_sizes[i]);
+            g_external_storage->WriteMetadata(position, metadata + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_write_buckets: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+extern "C" sgx_status_t ocall_write_path_buckets(
+    int tree_base,
+    int leafid,
+    int levels,
+    const size_t* data_sizes,
+    const uint8_t* metadata,
+    size_t meta_buf_size,
+    const size_t* meta_sizes) {
+
+    try {
+        if (!check_path_request(tree_base, leafid, levels, meta_buf_size)) {
+            return SGX_ERROR_INVALID_PARAMETER;
+        }
+
+        // 先校验所有层，避免写入半条路径
+        for (int i = 0; i < levels; i++) {
+            const uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            if (data_sizes[i] != 0 &&
+                (data_sizes[i] > MAX_SERIALIZED_BUCKET_SIZE ||
+                 serialized_bucket_length(slot, data_sizes[i]) != data_sizes[i] ||
+                 meta_sizes[i] > MAX_BUCKET_METADATA_SIZE)) {
+                std::cerr << "ERROR: Malformed bucket data for path level " << i << std::endl;
+                return SGX_ERROR_INVALID_PARAMETER;
+            }
+        }
+
+        for (int i = 0; i < levels; i++) {
+            if (data_sizes[i] == 0) {
+                continue;
+            }
+            int position = path_bucket_position(tree_base, leafid, i, levels);
+            const uint8_t* slot = g_staging_buffer.data() + i * MAX_SERIALIZED_BUCKET_SIZE;
+            g_external_storage->WriteBucketBytes(position, slot, data_sizes[i]);
+            g_external_storage->WriteMetadata(position, metadata + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+        }
+        return SGX_SUCCESS;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in ocall_write_path_buckets: " << e.what() << std::endl;
+        return SGX_ERROR_UNEXPECTED;
+    }
+}
+
+
+extern "C" void ocall_prefetch_paths(
+    int tree_base,
+    int levels,
+    int first_level,
+    const int* leaves,
+    int num_leaves) {
+
+    std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+    // 只是提示：参数不合法时直接忽略
+    if (!g_prefetch_running || !g_external_storage || levels <= 0 || levels > 31 || tree_base < 0 ||
+        static_cast<long long>(tree_base) + (1LL << levels) - 1 > g_external_storage->GetCapacity()) {
+        return;
+    }
+    for (int i = 0; i < num_leaves; i++) {
+        if (leaves[i] < 0 || leaves[i] >= (1LL << (levels - 1))) {
+            continue;
+        }
+        for (int level = std::max(first_level, 0); level < levels; level++) {
+            g_prefetch_queue.push_back(path_bucket_position(tree_base, leaves[i], level, levels));
+        }
+    }
+    while (g_prefetch_queue.size() > kMaxPrefetchQueue) {
+        g_prefetch_queue.pop_front();
+    }
+    g_prefetch_cv.notify_one();
+}
+
 
 // 文件操作 OCALL 实现
 extern "C" sgx_status_t ocall_read_file(
@@ -462,18 +725,56 @@ extern "C" void ocall_end_measurement(const char* operation_name) {
 // 外部存储初始化函数
 // ================================
 
-bool SGXEnclaveWrapper::initialize_external_storage(int capacity) {
+bool SGXEnclaveWrapper::initialize_external_storage(const OramConfig& config, int extra_buckets) {
+    if (!sameOramConfig(config, oram_config)) {
+        std::cerr << "Failed to initialize external storage: config differs from the one applied in the enclave" << std::endl;
+        return false;
+    }
+
+    // 旧存储上还有排队的驱逐任务时先执行完，避免后台线程写入重置后的存储
+    if (isEvictionWorkerRunning()) {
+        sgx_status_t ecall_ret = SGX_SUCCESS;
+        sgx_status_t ret = ecall_oram_flush_evictions(eid, &ecall_ret);
+        if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+            std::cerr << "Failed to flush queued evictions: sgx_ret=" << std::hex << ret
+                      << ", ecall_ret=" << ecall_ret << std::endl;
+        }
+    }
+
+    // 预取线程使用旧存储，更换前先停止
+    stop_path_prefetcher();
+
     try {
-        g_external_storage = std::make_unique<ServerStorage>();
-        g_external_storage->setCapacity(capacity);
-        
-        // 初始化所有 bucket
-        for (int i = 0; i < capacity; i++) {
-            bucket init_bkt(realBlockEachbkt, dummyBlockEachbkt);
-            g_external_storage->SetBucket(i, init_bkt);
+        // 先释放旧的存储，LAYOUT_MMAP 下保证桶文件在重新映射前已解除映射
+        g_external_storage.reset();
+        g_external_storage = std::make_unique<ServerStorage>(storage_layout);
+        if (storage_layout == LAYOUT_MMAP) {
+            g_external_storage->setBackingFile(storage_file, storage_hugepages);
         }
+        // 主树的桶数由两侧一致的全局参数（已按 config 应用）给出，递归位置图的内层树紧跟在主树之后，一并预留
+        long long total_buckets = static_cast<long long>(capacity) + posMapTreeBuckets(config.totalnumRealblock) +
+                                  std::max(0, extra_buckets);
+        if (total_buckets > INT_MAX) {
+            throw std::runtime_error("ORAM tree and position map trees exceed " + std::to_string(INT_MAX) + " buckets");
+        }
+        int num_buckets = static_cast<int>(total_buckets);
+        // setCapacity 之后所有桶都是空桶：LAYOUT_OBJECT 已逐个构造，稀疏与平坦布局中未写入的桶隐式为空
+        g_external_storage->setCapacity(num_buckets);
         
-        std::cout << "External storage initialized with capacity: " << capacity << std::endl;
+        std::cout << "External storage initialized with capacity: " << num_buckets;
+        if (storage_layout == LAYOUT_SPARSE) {
+            std::cout << " (sparse layout, buckets allocated on first write)";
+        } else if (storage_layout == LAYOUT_FLAT) {
+            std::cout << " (flat layout, slot stride " << g_external_storage->GetSlotStride() << " bytes)";
+        } else if (storage_layout == LAYOUT_MMAP) {
+            std::cout << " (mapped from " << storage_file << ")";
+        }
+        std::cout << std::endl;
+
+        // 只有映射自桶文件的存储会缺页，其他布局的桶常驻内存，不启动预取线程，Enclave 发来的提示直接忽略
+        if (storage_layout == LAYOUT_MMAP && oram_config.evictionPrefetch) {
+            start_path_prefetcher();
+        }
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Failed to initialize external storage: " << e.what() << std::endl;
@@ -482,24 +783,49 @@ bool SGXEnclaveWrapper::initialize_external_storage(int capacity) {
 }
 
 
-SGXEnclaveWrapper::SGXEnclaveWrapper() : eid(0), initialized(false) {
+SGXEnclaveWrapper::SGXEnclaveWrapper() : eid(0), initialized(false), switchless_workers(0), storage_layout(LAYOUT_OBJECT),
+    storage_hugepages(false), oram_config(currentOramConfig()) {
 }
 
 SGXEnclaveWrapper::~SGXEnclaveWrapper() {
     if (initialized) {
+        stopEvictionWorker();
+        stop_path_prefetcher();
+        if (switchless_workers > 0) {
+            SwitchlessStats stats = getSwitchlessStats();
+            std::cout << "Switchless OCALLs: processed=" << stats.processed
+                      << ", fallback=" << stats.missed << std::endl;
+        }
         sgx_destroy_enclave(eid);
         std::cout << "SGX enclave destroyed" << std::endl;
     }
 }
 
-bool SGXEnclaveWrapper::initializeEnclave(const std::string& enclave_path) {
+bool SGXEnclaveWrapper::initializeEnclave(const std::string& enclave_path, int switchless_workers) {
     sgx_status_t ret = SGX_SUCCESS;
     
-    ret = sgx_create_enclave(enclave_path.c_str(), SGX_DEBUG_FLAG, NULL, NULL, &eid, NULL);
+    if (switchless_workers > 0) {
+        // switchless 模式：ORAM 存储 OCALL 投递到请求队列，由 Host worker 线程处理
+        sgx_uswitchless_config_t us_config = SGX_USWITCHLESS_CONFIG_INITIALIZER;
+        us_config.num_uworkers = static_cast<uint32_t>(switchless_workers);
+        us_config.num_tworkers = 0;
+        us_config.callback_func[SGX_USWITCHLESS_WORKER_EVENT_IDLE] = on_switchless_worker_event;
+        us_config.callback_func[SGX_USWITCHLESS_WORKER_EVENT_MISS] = on_switchless_worker_event;
+        us_config.callback_func[SGX_USWITCHLESS_WORKER_EVENT_EXIT] = on_switchless_worker_event;
+
+        const void* enclave_ex_p[32] = { 0 };
+        enclave_ex_p[SGX_CREATE_ENCLAVE_EX_SWITCHLESS_BIT_IDX] = &us_config;
+
+        ret = sgx_create_enclave_ex(enclave_path.c_str(), SGX_DEBUG_FLAG, NULL, NULL, &eid, NULL,
+                                    SGX_CREATE_ENCLAVE_EX_SWITCHLESS, enclave_ex_p);
+    } else {
+        ret = sgx_create_enclave(enclave_path.c_str(), SGX_DEBUG_FLAG, NULL, NULL, &eid, NULL);
+    }
     if (ret != SGX_SUCCESS) {
         std::cerr << "Failed to create enclave: " << std::hex << ret << std::endl;
         return false;
     }
+    this->switchless_workers = switchless_workers;
     
     sgx_status_t ecall_ret = SGX_SUCCESS;
     ret = ecall_initialize_enclave(eid, &ecall_ret);
@@ -510,11 +836,147 @@ bool SGXEnclaveWrapper::initializeEnclave(const std::string& enclave_path) {
         return false;
     }
     
+    // 以当前全局参数同步两侧配置，并按其树高分配暂存区
+    if (!apply_config(currentOramConfig())) {
+        sgx_destroy_enclave(eid);
+        return false;
+    }
+    
     initialized = true;
-    std::cout << "SGX enclave initialized successfully" << std::endl;
+    std::cout << "SGX enclave initialized successfully";
+    if (switchless_workers > 0) {
+        std::cout << " (switchless, " << switchless_workers << " untrusted workers)";
+    }
+    std::cout << std::endl;
+
+    if (backgroundEviction && !startEvictionWorker()) {
+        std::cerr << "Background eviction unavailable, evicting inline" << std::endl;
+    }
     return true;
 }
 
+bool SGXEnclaveWrapper::configure(const OramConfig& config) {
+    if (!initialized) {
+        throw std::runtime_error("Enclave not initialized");
+    }
+    return apply_config(config);
+}
+
+bool SGXEnclaveWrapper::apply_config(const OramConfig& config) {
+    // Host 的全局参数先于 Enclave 更新，之后任何一步失败都恢复原值，避免两侧树形不一致；
+    // Enclave 已接受新参数时也把它改回原参数，并按原树高重新注册暂存区
+    OramConfig previous = currentOramConfig();
+    auto restore = [this, &previous](bool enclave_changed) {
+        applyOramConfig(previous);
+        if (!enclave_changed) {
+            return;
+        }
+        OramConfig reverted;
+        sgx_status_t ecall_ret = SGX_SUCCESS;
+        sgx_status_t ret = ecall_oram_configure(eid, &ecall_ret, reinterpret_cast<const uint8_t*>(&previous),
+                                                reinterpret_cast<uint8_t*>(&reverted), sizeof(OramConfig));
+        if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS || !register_staging_buffer()) {
+            std::cerr << "Failed to restore the previous ORAM config in the enclave" << std::endl;
+        }
+    };
+
+    try {
+        applyOramConfig(config);
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid ORAM config: " << e.what() << std::endl;
+        return false;
+    }
+
+    OramConfig applied;
+    memset(&applied, 0, sizeof(applied));
+    sgx_status_t ecall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ecall_oram_configure(eid, &ecall_ret, reinterpret_cast<const uint8_t*>(&config),
+                                            reinterpret_cast<uint8_t*>(&applied), sizeof(OramConfig));
+    if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+        std::cerr << "Failed to configure enclave ORAM: sgx_ret=" << std::hex << ret
+                  << ", ecall_ret=" << ecall_ret << std::endl;
+        restore(false);
+        return false;
+    }
+    if (!sameOramConfig(applied, currentOramConfig())) {
+        std::cerr << "Enclave applied an ORAM config different from the host's" << std::endl;
+        restore(true);
+        return false;
+    }
+
+    if (!register_staging_buffer()) {
+        restore(true);
+        return false;
+    }
+    oram_config = applied;
+    std::cout << "ORAM configured: " << totalnumRealblock << " blocks, L=" << OramL
+              << ", Z=" << realBlockEachbkt << ", S=" << dummyBlockEachbkt
+              << ", blocksize=" << blocksize << ", cacheLevel=" << cacheLevel << std::endl;
+    return true;
+}
+
+bool SGXEnclaveWrapper::register_staging_buffer() {
+    // 分配并注册暂存区，之后的桶/路径 OCALL 只按实际长度拷贝
+    // 容量为 evictionPaths 条整路径（每条 OramL + 1 层，每层一个桶槽），供整路径及多路径驱逐批量读写使用
+    g_staging_buffer.assign(static_cast<size_t>(OramL + 1) * std::max(1, evictionPaths) * MAX_SERIALIZED_BUCKET_SIZE, 0);
+    sgx_status_t ecall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ecall_register_staging_buffer(eid, &ecall_ret, g_staging_buffer.data(), g_staging_buffer.size());
+    if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+        std::cerr << "Failed to register staging buffer: sgx_ret=" << std::hex << ret 
+                  << ", ecall_ret=" << ecall_ret << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SGXEnclaveWrapper::startEvictionWorker() {
+    if (!initialized) {
+        throw std::runtime_error("Enclave not initialized");
+    }
+    if (eviction_thread.joinable()) {
+        return true;
+    }
+
+    // 该线程的 ecall 一直停留在 Enclave 内，直到 stopEvictionWorker
+    sgx_enclave_id_t id = eid;
+    eviction_thread = std::thread([id]() {
+        sgx_status_t ecall_ret = SGX_SUCCESS;
+        sgx_status_t ret = ecall_oram_eviction_worker(id, &ecall_ret);
+        if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+            std::cerr << "Background eviction worker exited: sgx_ret=" << std::hex << ret
+                      << ", ecall_ret=" << ecall_ret << std::endl;
+        }
+    });
+    std::cout << "Background eviction worker started (backlog " << evictionBacklog << ")" << std::endl;
+    return true;
+}
+
+void SGXEnclaveWrapper::stopEvictionWorker() {
+    if (!eviction_thread.joinable()) {
+        return;
+    }
+
+    sgx_status_t ecall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ecall_oram_stop_eviction_worker(eid, &ecall_ret);
+    if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+        std::cerr << "Failed to stop background eviction worker: sgx_ret=" << std::hex << ret
+                  << ", ecall_ret=" << ecall_ret << std::endl;
+    }
+    eviction_thread.join();
+}
+
+SwitchlessStats SGXEnclaveWrapper::getSwitchlessStats() const {
+    SwitchlessStats total = { 0, 0, 0 };
+
+    std::lock_guard<std::mutex> lock(g_switchless_mutex);
+    for (const auto& worker : g_switchless_worker_stats) {
+        total.processed += worker.second.processed;
+        total.missed += worker.second.missed;
+    }
+    total.miss_events = g_switchless_miss_events;
+    return total;
+}
+
 int SGXEnclaveWrapper::testEnclave(int input_value) {
     if (!initialized) {
         throw std::runtime_error("Enclave not initialized");
@@ -559,13 +1021,13 @@ bool SGXEnclaveWrapper::testORAMBasic() {
     }
     
     // 初始化外部存储
-    if (!initialize_external_storage(capacity)) {
+    if (!initialize_external_storage(oram_config)) {
         return false;
     }
     
     // 初始化 Enclave 内的 ORAM
     sgx_status_t ecall_ret = SGX_SUCCESS;
-    sgx_status_t ret = ecall_oram_initialize(eid, &ecall_ret, totalnumRealblock);
+    sgx_status_t ret = ecall_oram_initialize(eid, &ecall_ret, oram_config.totalnumRealblock);
     
     if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
         std::cerr << "ORAM initialization failed: sgx_ret=" << std::hex << ret 
@@ -583,7 +1045,7 @@ bool SGXEnclaveWrapper::testORAMAccess() {
     }
     
     // 初始化外部存储
-    if (!initialize_external_storage(capacity)) {
+    if (!initialize_external_storage(oram_config)) {
         return false;
     }
     
@@ -674,13 +1136,20 @@ bool SGXEnclaveWrapper::testRingOramStorage() {
         throw std::runtime_error("Enclave not initialized");
     }
     
-    // 确保ORAM已经初始化
-    if (!initialize_external_storage(capacity)) {
+    // 测试树各占主树之后的一段存储；存储重建后重新创建主 ORAM，测试不会写到它的桶
+    if (!initialize_external_storage(oram_config, storageTestBuckets(oram_config.totalnumRealblock))) {
         return false;
     }
-    
+
     sgx_status_t ecall_ret = SGX_SUCCESS;
-    sgx_status_t ret = ecall_test_ringoram_storage(eid, &ecall_ret);
+    sgx_status_t ret = ecall_oram_initialize(eid, &ecall_ret, oram_config.totalnumRealblock);
+    if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
+        std::cerr << "ORAM initialization failed: sgx_ret=" << std::hex << ret
+                  << ", ecall_ret=" << ecall_ret << std::endl;
+        return false;
+    }
+
+    ret = ecall_test_ringoram_storage(eid, &ecall_ret);
     
     if (ret != SGX_SUCCESS || ecall_ret != SGX_SUCCESS) {
         std::cerr << "RingOramStorage test failed: sgx_ret=" << std::hex << ret 
@@ -697,7 +1166,7 @@ bool SGXEnclaveWrapper::initializeIRTree(int dims, int min_cap, int max_cap) {
         throw std::runtime_error("Enclave not initialized");
     }
     
-    if (!initialize_external_storage(capacity)) {
+    if (!initialize_external_storage(oram_config)) {
         return false;
     }
 
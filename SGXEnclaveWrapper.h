@@ -6,20 +6,62 @@
 #include <stdexcept>
 #include <vector>  
 #include <cstdint> 
+#include <thread>
+#include "ServerStorage.h"
+#include "param.h"
+
+// switchless OCALL 的运行统计（由 untrusted worker 的事件回调汇总）
+struct SwitchlessStats {
+    uint64_t processed;    // 由 worker 线程处理的 switchless OCALL 数
+    uint64_t missed;       // worker 未能及时处理、回退为普通 OCALL 的次数
+    uint64_t miss_events;  // 收到的 SGX_USWITCHLESS_WORKER_EVENT_MISS 事件数
+};
 
 class SGXEnclaveWrapper {
 private:
     sgx_enclave_id_t eid;
     bool initialized;
+    int switchless_workers;
+    StorageLayout storage_layout;
+    std::string storage_file;
+    bool storage_hugepages;
+    // 后台驱逐线程：进入 Enclave 后执行排队的 EvictPath/EarlyReshuffle
+    std::thread eviction_thread;
+    // 两侧已确认一致的 ORAM 参数
+    OramConfig oram_config;
+
+    // 在 Host 与 Enclave 两侧应用配置并按新的树高重新注册暂存区
+    bool apply_config(const OramConfig& config);
+    bool register_staging_buffer();
 
 public:
     SGXEnclaveWrapper();
     ~SGXEnclaveWrapper();
     
     // 基础功能测试
-    bool initializeEnclave(const std::string& enclave_path = "enclave.signed.so");
+    // switchless_workers > 0 时以 switchless 模式创建 Enclave，
+    // 由该数量的 Host worker 线程处理标记为 transition_using_threads 的 OCALL
+    bool initializeEnclave(const std::string& enclave_path = "enclave.signed.so", int switchless_workers = 0);
     int testEnclave(int input_value);
-    bool initialize_external_storage(int capacity);
+    // 按 config 建立外部存储，config 必须与 configure 后两侧一致的配置相同；
+    // extra_buckets 为在主树与位置图树之后额外预留的桶（testRingOramStorage 的测试树放在这里）
+    bool initialize_external_storage(const OramConfig& config, int extra_buckets = 0);
+    // 运行时更换 ORAM 参数（例如按数据集大小缩小树），失败时两侧都保留原来的参数，
+    // 之后需重新 initializeIRTree / testORAMBasic 等建立存储与 ORAM；initializeEnclave 以当前全局参数调用一次
+    bool configure(const OramConfig& config);
+    const OramConfig& getOramConfig() const { return oram_config; }
+    // 启动/停止后台驱逐线程（占用 Enclave 的一个 TCS）；backgroundEviction 为 true 时由 initializeEnclave 启动
+    bool startEvictionWorker();
+    void stopEvictionWorker();
+    bool isEvictionWorkerRunning() const { return eviction_thread.joinable(); }
+    // 选择外部存储布局（默认 LAYOUT_OBJECT），在下一次 initialize_external_storage 时生效
+    void setStorageLayout(StorageLayout layout) { storage_layout = layout; }
+    // 使用映射自桶文件的外部存储（LAYOUT_MMAP），桶文件在每次初始化存储时清空重建
+    void setStorageBackingFile(const std::string& path, bool use_hugepages = false) {
+        storage_layout = LAYOUT_MMAP;
+        storage_file = path;
+        storage_hugepages = use_hugepages;
+    }
     // 加密功能测试
     bool testCrypto();
     bool testNodeSerializer();
@@ -39,6 +81,8 @@ public:
     
     // 状态查询
     bool isInitialized() const { return initialized; }
+    bool isSwitchless() const { return switchless_workers > 0; }
+    SwitchlessStats getSwitchlessStats() const;
     sgx_enclave_id_t getEnclaveId() const { return eid; }
 };
 
@@ -3,39 +3,691 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 using namespace std;
 
+// 槽位按缓存行对齐
+static const size_t kSlotAlignment = 64;
+// 桶文件头部所占空间（一页），保证 slab 页对齐
+static const size_t kMappedHeaderBytes = 4096;
+static const char kMappedMagic[8] = { 'S', 'G', 'X', 'B', 'K', 'T', '0', '1' };
+static const uint32_t kMappedVersion = 2;
 
 
-ServerStorage::ServerStorage() : capacity(0)
+// ================================
+// 序列化工具函数
+// ================================
+
+size_t calculate_bucket_size(const bucket& bkt) {
+
+    size_t size = sizeof(SerializedBucketHeader);
+
+    // 计算blocks大小
+    size_t blocks_size = 0;
+    for (int i = 0; i < bkt.blocks.size(); i++) {
+        const auto& blk = bkt.blocks[i];
+        size_t block_size = sizeof(SerializedBlockHeader) + blk.GetData().size();
+        blocks_size += block_size;
+
+    }
+    size += blocks_size;
+
+    // 计算ptrs和valids大小
+    size_t ptrs_valids_size = 2 * bkt.slots() * sizeof(int32_t);
+    size += ptrs_valids_size;
+
+    return size;
+}
+
+void serialize_block(const block& blk, uint8_t* buffer, size_t& offset) {
+
+    SerializedBlockHeader* header = reinterpret_cast<SerializedBlockHeader*>(buffer + offset);
+    header->leaf_id = blk.GetLeafid();
+    header->block_index = blk.GetBlockindex();
+
+    const auto& data = blk.GetData();
+    header->data_size = static_cast<int32_t>(data.size());
+
+    offset += sizeof(SerializedBlockHeader);
+
+    if (!data.empty()) {
+        memcpy(buffer + offset, data.data(), data.size());
+        offset += data.size();
+    }
+
+}
+
+block deserialize_block(const uint8_t* data, size_t& offset) {
+    const SerializedBlockHeader* header = reinterpret_cast<const SerializedBlockHeader*>(data + offset);
+    offset += sizeof(SerializedBlockHeader);
+
+    std::vector<char> block_data;
+    if (header->data_size > 0) {
+        block_data.resize(header->data_size);
+        memcpy(block_data.data(), data + offset, header->data_size);
+        offset += header->data_size;
+    }
+
+    return block(header->leaf_id, header->block_index, block_data);
+}
+
+std::vector<uint8_t> serialize_bucket(const bucket& bkt) {
+
+    try {
+
+        // 先计算大小
+
+        size_t total_size = calculate_bucket_size(bkt);
+
+        if (total_size == 0) {
+            std::cerr << "ERROR: Calculated size is 0" << std::endl;
+            return std::vector<uint8_t>();
+        }
+
+        std::vector<uint8_t> result(total_size);
+
+        // 序列化 bucket header
+
+        SerializedBucketHeader* bucket_header = reinterpret_cast<SerializedBucketHeader*>(result.data());
+        bucket_header->Z = bkt.Z;
+        bucket_header->S = bkt.S;
+        bucket_header->count = bkt.count;
+        bucket_header->num_blocks = static_cast<int32_t>(bkt.blocks.size());
+
+        size_t offset = sizeof(SerializedBucketHeader);
+
+        // 序列化 blocks
+
+        for (int i = 0; i < bkt.blocks.size(); i++) {
+
+            serialize_block(bkt.blocks[i], result.data(), offset);
+
+        }
+
+        // 序列化 ptrs 和 valids
+
+        int num_slots = bkt.Z + bkt.S;
+
+        // 检查边界
+        if (offset + num_slots * 2 * sizeof(int32_t) > total_size) {
+            std::cerr << "ERROR: Not enough space for ptrs and valids" << std::endl;
+            return std::vector<uint8_t>();
+        }
+
+        // 序列化 ptrs
+        for (int i = 0; i < num_slots; i++) {
+            *reinterpret_cast<int32_t*>(result.data() + offset) = bkt.ptrs[i];
+            offset += sizeof(int32_t);
+        }
+
+        // 序列化 valids
+        for (int i = 0; i < num_slots; i++) {
+            *reinterpret_cast<int32_t*>(result.data() + offset) = bkt.is_valid(i) ? 1 : 0;
+            offset += sizeof(int32_t);
+        }
+
+        return result;
+
+    } catch (const std::exception& e) {
+        std::cerr << "serialize_bucket failed with exception: " << e.what() << std::endl;
+        return std::vector<uint8_t>();
+    }
+}
+
+bucket deserialize_bucket(const uint8_t* data, size_t size) {
+
+    if (size < sizeof(SerializedBucketHeader)) {
+        std::cerr << "  ERROR: Data too small for header" << std::endl;
+        throw std::runtime_error("Invalid bucket data: too small");
+    }
+
+    const SerializedBucketHeader* bucket_header = reinterpret_cast<const SerializedBucketHeader*>(data);
+
+    // 创建空的bucket
+    bucket result(0, 0);
+    result.Z = bucket_header->Z;
+    result.S = bucket_header->S;
+    result.count = bucket_header->count;
+
+    size_t offset = sizeof(SerializedBucketHeader);
+
+    // 反序列化 blocks
+
+    for (int i = 0; i < bucket_header->num_blocks && offset < size; i++) {
+        result.blocks.push_back(deserialize_block(data, offset));
+    }
+
+    //从序列化数据中恢复ptrs和valids（result 由 bucket(0, 0) 构造，ptrs 全为 -1、没有有效槽位）
+    int num_slots = result.Z + result.S;
+    if (result.Z < 0 || result.S < 0 || num_slots > MAX_BUCKET_SLOTS) {
+        throw std::runtime_error("Invalid bucket data: bad slot count");
+    }
+
+    // 检查是否有足够的空间来读取ptrs和valids
+    if (offset + num_slots * 2 * sizeof(int32_t) <= size) {
+
+        // 反序列化 ptrs
+        for (int i = 0; i < num_slots; i++) {
+            int32_t ptr = *reinterpret_cast<const int32_t*>(data + offset);
+            result.ptrs[i] = ptr;
+            offset += sizeof(int32_t);
+        }
+
+        // 反序列化 valids
+        for (int i = 0; i < num_slots; i++) {
+            int32_t valid = *reinterpret_cast<const int32_t*>(data + offset);
+            result.set_valid(i, valid != 0);
+            offset += sizeof(int32_t);
+        }
+
+    } else {
+        std::cout << "  WARNING: No ptrs and valids data in serialized bucket" << std::endl;
+    }
+
+    return result;
+}
+
+// 只遍历块头，定位 ptrs/valids 区域；成功时返回线格式总长度
+static size_t locate_bucket_fields(const uint8_t* data, size_t size,
+                                   size_t* ptrs_offset, int* num_slots) {
+    if (size < sizeof(SerializedBucketHeader)) return 0;
+
+    SerializedBucketHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.Z < 0 || header.S < 0 || header.num_blocks < 0) return 0;
+
+    size_t offset = sizeof(SerializedBucketHeader);
+    for (int i = 0; i < header.num_blocks; i++) {
+        if (offset + sizeof(SerializedBlockHeader) > size) return 0;
+        SerializedBlockHeader block_header;
+        memcpy(&block_header, data + offset, sizeof(block_header));
+        if (block_header.data_size < 0) return 0;
+        offset += sizeof(SerializedBlockHeader) + block_header.data_size;
+    }
+
+    int slots = header.Z + header.S;
+    size_t total = offset + slots * 2 * sizeof(int32_t);
+    if (total > size) return 0;
+
+    if (ptrs_offset) *ptrs_offset = offset;
+    if (num_slots) *num_slots = slots;
+    return total;
+}
+
+size_t serialized_bucket_length(const uint8_t* data, size_t size) {
+    return locate_bucket_fields(data, size, nullptr, nullptr);
+}
+
+static int32_t load_i32(const uint8_t* p) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+ServerStorage::ServerStorage() : ServerStorage(LAYOUT_OBJECT)
+{
+}
+
+ServerStorage::ServerStorage(StorageLayout layout, size_t slot_payload_bytes)
+    : capacity(0), layout(layout), slab(nullptr), slab_bytes(0),
+      map_base(nullptr), map_bytes(0),
+      slot_payload(slot_payload_bytes), slot_stride(0),
+      use_hugepages(false), preallocate(true), backing_fd(-1)
 {
     buckets = std::vector<bucket>();
+
+    if (this->slot_payload == 0) {
+        // 每个槽位按满载的桶预留：Z+S 个最大尺寸的加密块 + ptrs/valids
+        size_t slots = realBlockEachbkt + dummyBlockEachbkt;
+        this->slot_payload = sizeof(SerializedBucketHeader)
+            + slots * (sizeof(SerializedBlockHeader) + blocksize + kBlockCryptoOverhead)
+            + slots * 2 * sizeof(int32_t);
+    }
+}
+
+ServerStorage::~ServerStorage()
+{
+    releaseSlab();
+}
+
+void ServerStorage::releaseSlab()
+{
+    if (map_base) {
+        munmap(map_base, map_bytes);
+        map_base = nullptr;
+        map_bytes = 0;
+    }
+    slab = nullptr;
+    slab_bytes = 0;
+
+    if (backing_fd >= 0) {
+        close(backing_fd);
+        backing_fd = -1;
+    }
+}
+
+void ServerStorage::setBackingFile(const std::string& path, bool use_hugepages, bool preallocate)
+{
+    this->backing_path = path;
+    this->use_hugepages = use_hugepages;
+    this->preallocate = preallocate;
+}
+
+void ServerStorage::Flush()
+{
+    if (layout == LAYOUT_MMAP && map_base) {
+        if (msync(map_base, map_bytes, MS_SYNC) != 0) {
+            std::cerr << "WARNING: msync of " << backing_path << " failed: " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+void ServerStorage::PrefetchBucket(int position) const
+{
+    if (layout != LAYOUT_MMAP || slab == nullptr || position < 0 || position >= capacity) {
+        return;
+    }
+    static const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(slotHeader(position)) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(slotHeader(position)) + slot_stride;
+#ifdef MADV_POPULATE_READ
+    // 直接建立页表项，之后的 ReadBucketBytes 不再缺页
+    if (madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_READ) == 0) {
+        return;
+    }
+#endif
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+// 打开或创建桶文件，清空重建后以 MAP_SHARED 映射
+void ServerStorage::mapBackingFile()
+{
+    if (backing_path.empty()) {
+        throw runtime_error("LAYOUT_MMAP requires a backing file, call setBackingFile first");
+    }
+
+    backing_fd = open(backing_path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (backing_fd < 0) {
+        throw runtime_error("Failed to open bucket file " + backing_path + ": " + strerror(errno));
+    }
+
+    MappedFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMappedMagic, sizeof(kMappedMagic));
+    header.version = kMappedVersion;
+    header.capacity = capacity;
+    header.slot_stride = slot_stride;
+    header.slot_payload = slot_payload;
+    header.Z = realBlockEachbkt;
+    header.S = dummyBlockEachbkt;
+    header.blocksize = blocksize;
+
+    map_bytes = kMappedHeaderBytes + slab_bytes;
+
+    // 清空后重新建立，全零槽位即空桶
+    if (ftruncate(backing_fd, 0) != 0 || ftruncate(backing_fd, static_cast<off_t>(map_bytes)) != 0) {
+        throw runtime_error("Failed to size bucket file " + backing_path + ": " + strerror(errno));
+    }
+    if (preallocate) {
+        // 预先分配磁盘块，避免写入缺页时因空间不足触发 SIGBUS
+        int err = posix_fallocate(backing_fd, 0, static_cast<off_t>(map_bytes));
+        if (err == ENOSPC) {
+            throw runtime_error("Not enough disk space to preallocate " + to_string(map_bytes) + " bytes for " + backing_path);
+        }
+        if (err != 0) {
+            std::cerr << "WARNING: posix_fallocate on " << backing_path << " failed (" << strerror(err) << "), using a sparse file" << std::endl;
+        }
+    }
+    if (pwrite(backing_fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        throw runtime_error("Failed to write bucket file header to " + backing_path);
+    }
+
+    void* mem = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, backing_fd, 0);
+    if (mem == MAP_FAILED) {
+        throw runtime_error("Failed to mmap bucket file " + backing_path + ": " + strerror(errno));
+    }
+    map_base = static_cast<uint8_t*>(mem);
+    slab = map_base + kMappedHeaderBytes;
+
+    // ORAM 路径在树中随机分布，关闭预读
+    madvise(slab, slab_bytes, MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+    if (use_hugepages && madvise(map_base, map_bytes, MADV_HUGEPAGE) != 0) {
+        std::cerr << "WARNING: MADV_HUGEPAGE not supported for " << backing_path << ": " << strerror(errno) << std::endl;
+    }
+#endif
 }
 
 void ServerStorage::setCapacity(int totalNumOfBuckets)
 {
 
     this->capacity = totalNumOfBuckets;
-    this->buckets.assign(totalNumOfBuckets, bucket(realBlockEachbkt, dummyBlockEachbkt));
-}
 
+    if (layout == LAYOUT_OBJECT) {
+        this->buckets.assign(totalNumOfBuckets, bucket(realBlockEachbkt, dummyBlockEachbkt));
+        this->object_metadata.assign(totalNumOfBuckets, std::vector<uint8_t>());
+        return;
+    }
 
+    if (layout == LAYOUT_SPARSE) {
+        // 桶在第一次写入时才分配
+        this->sparse_buckets.clear();
+        this->sparse_metadata.clear();
+        this->empty_bucket_bytes = serialize_bucket(bucket(realBlockEachbkt, dummyBlockEachbkt));
+        return;
+    }
 
+    releaseSlab();
+    this->buckets.clear();
+    this->object_metadata.clear();
+    // 读从未写入的槽位时拷出空桶，不写槽位本身
+    this->empty_bucket_bytes = serialize_bucket(bucket(realBlockEachbkt, dummyBlockEachbkt));
+
+    size_t raw = sizeof(FlatSlotHeader) + MAX_BUCKET_METADATA_SIZE + slot_payload;
+    slot_stride = (raw + kSlotAlignment - 1) / kSlotAlignment * kSlotAlignment;
+    slab_bytes = slot_stride * static_cast<size_t>(totalNumOfBuckets);
+
+    if (layout == LAYOUT_MMAP) {
+        mapBackingFile();
+        return;
+    }
 
-bucket& ServerStorage::GetBucket(int position)
+    // 匿名映射按页懒分配：从未写入的槽位保持全零（used_bytes == 0），不占物理内存
+    void* mem = mmap(nullptr, slab_bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        slab_bytes = 0;
+        throw runtime_error("Failed to allocate flat bucket slab of " + to_string(slot_stride) + " x " + to_string(totalNumOfBuckets) + " bytes");
+    }
+    map_base = static_cast<uint8_t*>(mem);
+    map_bytes = slab_bytes;
+    slab = map_base;
+}
+
+void ServerStorage::checkPosition(int position) const
 {
     if (position >= this->capacity || position < 0) {
         throw runtime_error("You are trying to access Bucket " + to_string(position) + ", but this Server contains only " + to_string(this->capacity) + " buckets.");
     }
-   
-    return this->buckets.at(position);
 }
 
-void ServerStorage::SetBucket(int position, bucket& bucketTowrite)
+size_t ServerStorage::GetMaterializedBuckets() const
 {
-    if (position >= this->capacity || position < 0) {
-        throw runtime_error("You are trying to access Bucket " + to_string(position) + ", but this Server contains only " + to_string(this->capacity) + " buckets.");
+    if (layout == LAYOUT_SPARSE) {
+        return sparse_buckets.size();
+    }
+    return layout == LAYOUT_OBJECT ? buckets.size() : 0;
+}
+
+const bucket* ServerStorage::findObjectBucket(int position) const
+{
+    if (layout == LAYOUT_OBJECT) {
+        return &this->buckets.at(position);
+    }
+    auto it = this->sparse_buckets.find(position);
+    return it == this->sparse_buckets.end() ? nullptr : &it->second;
+}
+
+bucket& ServerStorage::objectBucket(int position)
+{
+    if (layout == LAYOUT_OBJECT) {
+        return this->buckets.at(position);
     }
+    auto it = this->sparse_buckets.find(position);
+    if (it == this->sparse_buckets.end()) {
+        it = this->sparse_buckets.emplace(position, bucket(realBlockEachbkt, dummyBlockEachbkt)).first;
+    }
+    return it->second;
+}
+
+FlatSlotHeader* ServerStorage::slotHeader(int position) const
+{
+    return reinterpret_cast<FlatSlotHeader*>(slab + slot_stride * static_cast<size_t>(position));
+}
+
+uint8_t* ServerStorage::slotMetadata(int position) const
+{
+    return slab + slot_stride * static_cast<size_t>(position) + sizeof(FlatSlotHeader);
+}
+
+uint8_t* ServerStorage::slotData(int position) const
+{
+    return slotMetadata(position) + MAX_BUCKET_METADATA_SIZE;
+}
 
-    this->buckets.at(position) = bucketTowrite;
-}
\ No newline at end of file
+bucket ServerStorage::GetBucket(int position) const
+{
+    checkPosition(position);
+
+    if (isObjectLayout()) {
+        const bucket* bkt = findObjectBucket(position);
+        return bkt ? *bkt : bucket(realBlockEachbkt, dummyBlockEachbkt);
+    }
+
+    const FlatSlotHeader* header = slotHeader(position);
+    if (header->used_bytes == 0) {
+        return bucket(realBlockEachbkt, dummyBlockEachbkt);
+    }
+    return deserialize_bucket(slotData(position), header->used_bytes);
+}
+
+void ServerStorage::SetBucket(int position, const bucket& bucketTowrite)
+{
+    checkPosition(position);
+
+    if (isObjectLayout()) {
+        objectBucket(position) = bucketTowrite;
+        return;
+    }
+
+    std::vector<uint8_t> serialized = serialize_bucket(bucketTowrite);
+    WriteBucketBytes(position, serialized.data(), serialized.size());
+}
+
+size_t ServerStorage::ReadBucketBytes(int position, uint8_t* out, size_t max_size)
+{
+    checkPosition(position);
+
+    if (isObjectLayout()) {
+        // 未写过的桶直接拷出预先序列化好的空桶
+        const bucket* bkt = findObjectBucket(position);
+        std::vector<uint8_t> serialized;
+        if (bkt) {
+            serialized = serialize_bucket(*bkt);
+        }
+        const std::vector<uint8_t>& bytes = bkt ? serialized : empty_bucket_bytes;
+        if (bytes.size() > max_size) {
+            throw runtime_error("Serialized bucket " + to_string(position) + " is " + to_string(bytes.size()) + " bytes, buffer holds " + to_string(max_size));
+        }
+        memcpy(out, bytes.data(), bytes.size());
+        return bytes.size();
+    }
+
+    // 从未写入的槽位与稀疏布局一样拷出预先序列化好的空桶，读路径不写槽位（LAYOUT_MMAP 下不弄脏文件页）
+    const FlatSlotHeader* header = slotHeader(position);
+    if (header->used_bytes == 0) {
+        if (empty_bucket_bytes.size() > max_size) {
+            throw runtime_error("Serialized bucket " + to_string(position) + " is " + to_string(empty_bucket_bytes.size()) + " bytes, buffer holds " + to_string(max_size));
+        }
+        memcpy(out, empty_bucket_bytes.data(), empty_bucket_bytes.size());
+        return empty_bucket_bytes.size();
+    }
+    if (header->used_bytes > max_size) {
+        throw runtime_error("Bucket slot " + to_string(position) + " holds " + to_string(header->used_bytes) + " bytes, buffer holds " + to_string(max_size));
+    }
+    memcpy(out, slotData(position), header->used_bytes);
+    return header->used_bytes;
+}
+
+void ServerStorage::WriteBucketBytes(int position, const uint8_t* data, size_t size)
+{
+    checkPosition(position);
+
+    if (isObjectLayout()) {
+        objectBucket(position) = deserialize_bucket(data, size);
+        return;
+    }
+
+    if (size > slot_payload) {
+        throw runtime_error("Bucket " + to_string(position) + " needs " + to_string(size) + " bytes, but flat slots hold only " + to_string(slot_payload));
+    }
+    memcpy(slotData(position), data, size);
+    slotHeader(position)->used_bytes = static_cast<uint32_t>(size);
+}
+
+size_t ServerStorage::ReadMetadata(int position, uint8_t* out, size_t max_size) const
+{
+    checkPosition(position);
+
+    const uint8_t* src = nullptr;
+    size_t size = 0;
+    if (layout == LAYOUT_OBJECT) {
+        src = this->object_metadata.at(position).data();
+        size = this->object_metadata.at(position).size();
+    } else if (layout == LAYOUT_SPARSE) {
+        auto it = this->sparse_metadata.find(position);
+        if (it != this->sparse_metadata.end()) {
+            src = it->second.data();
+            size = it->second.size();
+        }
+    } else {
+        src = slotMetadata(position);
+        size = slotHeader(position)->metadata_bytes;
+    }
+
+    if (size > max_size) {
+        throw runtime_error("Metadata of bucket " + to_string(position) + " is " + to_string(size) + " bytes, buffer holds " + to_string(max_size));
+    }
+    if (size > 0) {
+        memcpy(out, src, size);
+    }
+    return size;
+}
+
+void ServerStorage::WriteMetadata(int position, const uint8_t* data, size_t size)
+{
+    checkPosition(position);
+
+    if (size > MAX_BUCKET_METADATA_SIZE) {
+        throw runtime_error("Metadata of bucket " + to_string(position) + " is " + to_string(size) + " bytes, limit is " + to_string(MAX_BUCKET_METADATA_SIZE));
+    }
+
+    if (layout == LAYOUT_OBJECT) {
+        this->object_metadata.at(position).assign(data, data + size);
+        return;
+    }
+    if (layout == LAYOUT_SPARSE) {
+        this->sparse_metadata[position].assign(data, data + size);
+        return;
+    }
+
+    memcpy(slotMetadata(position), data, size);
+    slotHeader(position)->metadata_bytes = static_cast<uint32_t>(size);
+}
+
+// 平坦布局：只跳过前 offset 个块头，定位第 offset 个块的数据，不解析整个桶
+const uint8_t* ServerStorage::locateSlotBlock(int position, int offset, size_t* size) const
+{
+    *size = 0;
+
+    // 从未写入的槽位是全 dummy 的空桶，dummy 块没有数据
+    const FlatSlotHeader* header = slotHeader(position);
+    if (header->used_bytes == 0) {
+        return nullptr;
+    }
+
+    const uint8_t* data = slotData(position);
+    size_t used = header->used_bytes;
+    if (offset < 0 || offset >= load_i32(data + offsetof(SerializedBucketHeader, num_blocks))) {
+        throw runtime_error("Slot " + to_string(offset) + " has no block in bucket " + to_string(position));
+    }
+
+    size_t block_offset = sizeof(SerializedBucketHeader);
+    for (int j = 0; j <= offset; j++) {
+        if (block_offset + sizeof(SerializedBlockHeader) > used) {
+            throw runtime_error("Corrupted bucket slot " + to_string(position));
+        }
+        int32_t data_size = load_i32(data + block_offset + offsetof(SerializedBlockHeader, data_size));
+        if (data_size < 0 || block_offset + sizeof(SerializedBlockHeader) + data_size > used) {
+            throw runtime_error("Corrupted bucket slot " + to_string(position));
+        }
+        if (j == offset) {
+            *size = static_cast<size_t>(data_size);
+            return data + block_offset + sizeof(SerializedBlockHeader);
+        }
+        block_offset += sizeof(SerializedBlockHeader) + data_size;
+    }
+    return nullptr;
+}
+
+size_t ServerStorage::ReadBlockBytes(int position, int offset, uint8_t* out, size_t max_size)
+{
+    checkPosition(position);
+
+    if (isObjectLayout()) {
+        // 未写过的桶是全 dummy 的空桶，dummy 块没有数据
+        const bucket* bkt = findObjectBucket(position);
+        int num_blocks = bkt ? static_cast<int>(bkt->blocks.size()) : realBlockEachbkt + dummyBlockEachbkt;
+        if (offset < 0 || offset >= num_blocks) {
+            throw runtime_error("Slot " + to_string(offset) + " has no block in bucket " + to_string(position));
+        }
+        if (!bkt) {
+            return 0;
+        }
+        const vector<char>& data = bkt->blocks[offset].GetData();
+        if (data.size() > max_size) {
+            throw runtime_error("Block in bucket " + to_string(position) + " is " + to_string(data.size()) + " bytes, buffer holds " + to_string(max_size));
+        }
+        if (!data.empty()) {
+            memcpy(out, data.data(), data.size());
+        }
+        return data.size();
+    }
+
+    size_t size = 0;
+    const uint8_t* data = locateSlotBlock(position, offset, &size);
+    if (size > max_size) {
+        throw runtime_error("Block in bucket " + to_string(position) + " is " + to_string(size) + " bytes, buffer holds " + to_string(max_size));
+    }
+    if (size > 0) {
+        memcpy(out, data, size);
+    }
+    return size;
+}
+
+size_t ServerStorage::XorBlockBytes(int position, int offset, uint8_t* acc, size_t max_size)
+{
+    checkPosition(position);
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    if (isObjectLayout()) {
+        const bucket* bkt = findObjectBucket(position);
+        int num_blocks = bkt ? static_cast<int>(bkt->blocks.size()) : realBlockEachbkt + dummyBlockEachbkt;
+        if (offset < 0 || offset >= num_blocks) {
+            throw runtime_error("Slot " + to_string(offset) + " has no block in bucket " + to_string(position));
+        }
+        if (bkt) {
+            const vector<char>& blk = bkt->blocks[offset].GetData();
+            data = reinterpret_cast<const uint8_t*>(blk.data());
+            size = blk.size();
+        }
+    } else {
+        data = locateSlotBlock(position, offset, &size);
+    }
+
+    if (size > max_size) {
+        throw runtime_error("Block in bucket " + to_string(position) + " is " + to_string(size) + " bytes, buffer holds " + to_string(max_size));
+    }
+    for (size_t i = 0; i < size; i++) {
+        acc[i] ^= data[i];
+    }
+    return size;
+}
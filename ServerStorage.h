@@ -1,24 +1,135 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include"bucket.h"
 #include"block.h"
 #include<vector>
+#include<string>
+#include<unordered_map>
 
+// 桶的存储布局
+enum StorageLayout {
+    LAYOUT_OBJECT = 0,  // 每个桶是一个独立的 bucket 对象（vector<block> 等）
+    LAYOUT_FLAT = 1,    // 所有桶位于一块连续的 slab 中，每个桶占一个定长、按缓存行对齐的槽位
+    LAYOUT_MMAP = 2,    // 与 LAYOUT_FLAT 相同的槽位，slab 映射自预分配的桶文件（MAP_SHARED）
+    LAYOUT_SPARSE = 3   // 与 LAYOUT_OBJECT 相同的 bucket 对象，但只为写过的桶分配（按位置的哈希表），
+                        // 其余桶隐式为全 dummy 的空桶，内存随树中被占用的部分增长。
+                        // 需经 setStorageLayout 选用，并打开 bulkLoadSkipEmpty：否则 ringoram::bulk_load 会写出每个桶，
+                        // 批量建树之后整棵树都已分配，且按桶的哈希表比 LAYOUT_OBJECT 更占内存
+};
 
+// 平坦布局中每个槽位的头部，后面依次是 MAX_BUCKET_METADATA_SIZE 字节的加密元数据区
+// 和桶的序列化字节（与 OCALL 线格式相同）
+struct FlatSlotHeader {
+    uint32_t used_bytes;      // 槽位中有效的序列化字节数，0 表示从未写入（等价于全 dummy 的空桶）
+    uint32_t metadata_bytes;  // 元数据区中有效的字节数，0 表示尚未写入元数据
+};
+
+// LAYOUT_MMAP 桶文件的头部，占用文件的第一页，槽位从第二页开始
+struct MappedFileHeader {
+    char magic[8];          // "SGXBKT01"
+    uint32_t version;
+    int32_t capacity;       // 桶数量
+    uint64_t slot_stride;
+    uint64_t slot_payload;
+    int32_t Z;
+    int32_t S;
+    int32_t blocksize;
+};
+
+// 桶序列化工具（Host 端）
+size_t calculate_bucket_size(const bucket& bkt);
+void serialize_block(const block& blk, uint8_t* buffer, size_t& offset);
+block deserialize_block(const uint8_t* data, size_t& offset);
+std::vector<uint8_t> serialize_bucket(const bucket& bkt);
+bucket deserialize_bucket(const uint8_t* data, size_t size);
+
+// 在不反序列化的情况下计算线格式桶的实际长度，格式非法时返回 0
+size_t serialized_bucket_length(const uint8_t* data, size_t size);
 
 class ServerStorage
 {
 public:
-    std::vector<bucket> buckets;  // 存储所有的bucket
+    std::vector<bucket> buckets;  // 存储所有的bucket（仅 LAYOUT_OBJECT 使用）
 
     ServerStorage();
+    explicit ServerStorage(StorageLayout layout, size_t slot_payload_bytes = 0);
+    ~ServerStorage();
+
+    ServerStorage(const ServerStorage&) = delete;
+    ServerStorage& operator=(const ServerStorage&) = delete;
+
+    // LAYOUT_MMAP：指定桶文件路径，须在 setCapacity 之前调用；已有文件总是清空重建
+    // （Enclave 的密钥、位置图和桶计数每次启动都是新的，复用旧文件中的树无法解密）
+    void setBackingFile(const std::string& path, bool use_hugepages = false, bool preallocate = true);
+
     void setCapacity(int totalNumOfBuckets);  // 设置存储系统的总容量（桶的数量）
 
-    bucket& GetBucket(int position);
-    void SetBucket(int position, bucket& bucketTowrite);
+    bucket GetBucket(int position) const;
+    void SetBucket(int position, const bucket& bucketTowrite);
+
+    // 以线格式读写桶：平坦布局直接 memcpy 槽位，对象布局做一次序列化/反序列化
+    size_t ReadBucketBytes(int position, uint8_t* out, size_t max_size);
+    void WriteBucketBytes(int position, const uint8_t* data, size_t size);
+
+    // 桶的加密元数据（不透明字节），从未写入时返回 0
+    size_t ReadMetadata(int position, uint8_t* out, size_t max_size) const;
+    void WriteMetadata(int position, const uint8_t* data, size_t size);
+
+    // 只取出桶中第 offset 个槽位的块数据，用于 Enclave 规划好的 ReadPath
+    size_t ReadBlockBytes(int position, int offset, uint8_t* out, size_t max_size);
+    // 与 ReadBlockBytes 相同，但把块数据异或进 acc（XOR 压缩的 ReadPath）
+    size_t XorBlockBytes(int position, int offset, uint8_t* acc, size_t max_size);
 
     int GetCapacity() const { return capacity; }
+    // 已分配的桶数：LAYOUT_SPARSE 为写过的桶数，LAYOUT_OBJECT 为容量，平坦布局返回 0（按页懒分配，由内核统计）
+    size_t GetMaterializedBuckets() const;
+    StorageLayout GetLayout() const { return layout; }
+    size_t GetSlotStride() const { return slot_stride; }
+
+    // LAYOUT_MMAP：将脏页同步写回桶文件
+    void Flush();
+    // LAYOUT_MMAP：把桶的槽位所在的页调入内存（只是提示，失败时忽略）；其他布局的桶常驻内存，不做任何事
+    void PrefetchBucket(int position) const;
 
 private:
     int capacity;  // 总的bucket数量
-};
\ No newline at end of file
+    StorageLayout layout;
+
+    // LAYOUT_OBJECT 的桶元数据
+    std::vector<std::vector<uint8_t>> object_metadata;
+
+    // LAYOUT_SPARSE：按位置分配的桶和元数据，不在表中的桶从未写过
+    std::unordered_map<int, bucket> sparse_buckets;
+    std::unordered_map<int, std::vector<uint8_t>> sparse_metadata;
+    // 全 dummy 空桶的线格式，读未写过的桶时直接拷出
+    std::vector<uint8_t> empty_bucket_bytes;
+
+    // 平坦布局的 slab（LAYOUT_MMAP 时位于映射区域第一页之后）
+    uint8_t* slab;
+    size_t slab_bytes;
+    uint8_t* map_base;
+    size_t map_bytes;
+    size_t slot_payload;  // 每个槽位可容纳的最大序列化字节数
+    size_t slot_stride;   // 槽位间距（含 FlatSlotHeader，按 64 字节对齐）
+
+    // LAYOUT_MMAP 的桶文件
+    std::string backing_path;
+    bool use_hugepages;
+    bool preallocate;
+    int backing_fd;
+
+    void checkPosition(int position) const;
+    bool isObjectLayout() const { return layout == LAYOUT_OBJECT || layout == LAYOUT_SPARSE; }
+    // 对象布局下取桶：LAYOUT_SPARSE 中未写过的桶返回 nullptr（视为空桶）
+    const bucket* findObjectBucket(int position) const;
+    // 对象布局下取可写的桶，LAYOUT_SPARSE 中按需分配
+    bucket& objectBucket(int position);
+    FlatSlotHeader* slotHeader(int position) const;
+    uint8_t* slotMetadata(int position) const;
+    uint8_t* slotData(int position) const;
+    const uint8_t* locateSlotBlock(int position, int offset, size_t* size) const;
+    void releaseSlab();
+    void mapBackingFile();
+};
@@ -7,7 +7,7 @@ block::block()
 }
 
 block::block(int leaf_id, int blockindex, vector<char> data)
-    :leaf_id(leaf_id), blockindex(blockindex), data(data)
+    :leaf_id(leaf_id), blockindex(blockindex), data(std::move(data))
 {
 }
 
@@ -31,13 +31,18 @@ void block::SetLeafid(int lead_id)
     this->leaf_id = lead_id;
 }
 
-vector<char> block::GetData() const
+const vector<char>& block::GetData() const
 {
     return data;
 }
 
+vector<char> block::TakeData()
+{
+    return std::move(data);
+}
+
 void block::SetData(vector<char> data)
 {
-    this->data = data;
+    this->data = std::move(data);
 }
 
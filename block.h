@@ -14,12 +14,16 @@ private:
 
 public:
     block();
+    // data 按值传入后移入块内：调用方传右值（std::move）时不拷贝
     block(int leaf_id, int blockindex, vector<char> data);
     int GetBlockindex() const;        
     void SetBlockindex(int blockindex);
     int GetLeafid() const;            
     void SetLeafid(int lead_id);
-    vector<char> GetData() const;     
+    // 只读视图，不拷贝；引用在块被修改或销毁前有效
+    const vector<char>& GetData() const;
+    // 取走数据交给调用方，块的数据随之为空
+    vector<char> TakeData();
     void SetData(vector<char> data);
     bool IsDummy() const {
         return blockindex == -1;
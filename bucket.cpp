@@ -1,9 +1,10 @@
 #include "bucket.h"
 #include "param.h"
+#include <stdexcept>
 
 #ifdef INSIDE_ENCLAVE
-    // Enclave 内使用 SGX 安全的随机数
-    #include <sgx_trts.h>
+    // Enclave 内使用 DRBG 的随机数
+    #include "drbg.h"
     extern "C" void ocall_print_string(const char* str);
 #else
     // Host 端使用标准库
@@ -13,24 +14,41 @@
     #include <cstdio>
 #endif
 
-bucket::bucket() :Z(realBlockEachbkt), S(dummyBlockEachbkt), blocks(Z + S, dummyBlock), count(0), ptrs(Z + S, -1), valids(Z + S, 1)
+bucket::bucket() :bucket(realBlockEachbkt, dummyBlockEachbkt)
 {
 }
 
 bucket::bucket(int Z, int S)
-    :Z(Z), S(S), blocks(Z + S, dummyBlock), count(0), ptrs(Z + S, -1), valids(Z + S, 1)
+    :Z(Z), S(S), blocks(Z + S, dummyBlock), count(0), valid(full_slot_mask(Z + S)), nonce(0), tag{}
 {
+    if (Z + S > MAX_BUCKET_SLOTS)
+    {
+        throw std::length_error("bucket has more slots than MAX_BUCKET_SLOTS");
+    }
+    ptrs.fill(-1);
+    digests.fill(0);
 }
 
-int bucket::GetDummyblockOffset() const
+void bucket::set_valid(int i, bool is_valid)
+{
+    slot_mask_t bit = slot_mask_t(1) << i;
+    valid = is_valid ? (valid | bit) : (valid & ~bit);
+}
+
+slot_mask_t bucket::dummy_slots() const
 {
-    vector<int> dummyoffset;
-    for (int i = 0; i < (Z + S); i++)
+    slot_mask_t mask = 0;
+    for (int i = 0; i < Z + S; i++)
     {
-        if (ptrs[i] == -1 && valids[i] == 1)
-            dummyoffset.push_back(i);
+        mask |= static_cast<slot_mask_t>(ptrs[i] == -1) << i;
     }
-    if (dummyoffset.empty())
+    return mask;
+}
+
+int bucket::GetDummyblockOffset() const
+{
+    slot_mask_t mask = dummy_mask();
+    if (mask == 0)
     {
 #ifdef INSIDE_ENCLAVE
         ocall_print_string("no valid dummyblock");
@@ -41,17 +59,12 @@ int bucket::GetDummyblockOffset() const
     }
 
 #ifdef INSIDE_ENCLAVE
-    // Enclave 内使用 SGX 安全的随机数
-    uint32_t random_value;
-    sgx_status_t ret = sgx_read_rand((uint8_t*)&random_value, sizeof(random_value));
-    if (ret != SGX_SUCCESS) {
-        return 0; // 失败时返回第一个位置
-    }
-    return dummyoffset[random_value % dummyoffset.size()];
+    // Enclave 内使用 DRBG 的随机数
+    return select_slot(mask, Drbg::global().uniform(static_cast<uint32_t>(slot_count(mask))));
 #else
     // Host 端使用标准随机数
     static std::mt19937 rng(static_cast<unsigned>(time(nullptr)));
-    std::uniform_int_distribution<int> dist(0, dummyoffset.size() - 1);
-    return dummyoffset[dist(rng)];
+    std::uniform_int_distribution<int> dist(0, slot_count(mask) - 1);
+    return select_slot(mask, static_cast<uint32_t>(dist(rng)));
 #endif
 }
\ No newline at end of file
@@ -1,5 +1,66 @@
 #pragma once
 #include"block.h"
+#include<cstdint>
+#include<cstddef>
+#include<array>
+
+// 序列化结构定义（Enclave 与 Host 共用的桶线格式）
+#pragma pack(push, 1)
+struct SerializedBucketHeader {
+    int32_t Z;
+    int32_t S;
+    int32_t count;
+    int32_t num_blocks;
+};
+
+struct SerializedBlockHeader {
+    int32_t leaf_id;
+    int32_t block_index;
+    int32_t data_size;
+    // 变长数据跟在后面
+};
+#pragma pack(pop)
+
+// 单个序列化桶（或单个块）允许的最大字节数，也是暂存区的最小容量
+static const size_t MAX_SERIALIZED_BUCKET_SIZE = 65536;
+
+// 桶元数据（count、ptrs、valids、各槽位的叶子）由 Enclave 加密后单独存放，Host 只当作不透明字节保存
+// 每个桶的元数据最多占用的字节数，也是路径元数据批量传输时每层的间距
+static const size_t MAX_BUCKET_METADATA_SIZE = 256;
+
+// 槽位位掩码：第 i 位对应桶的第 i 个槽位。元数据槽的大小已把 Z+S 限制在 18 以内，32 位足够；
+// 桶的逐槽位数组也按 MAX_BUCKET_SLOTS 定长存放（bucketFitsLimits 保证 Z+S 不超过它）
+typedef uint32_t slot_mask_t;
+static const int MAX_BUCKET_SLOTS = 32;
+
+// 低 slots 位全部置位的掩码
+inline slot_mask_t full_slot_mask(int slots) {
+    return slots >= MAX_BUCKET_SLOTS ? ~slot_mask_t(0) : (slot_mask_t(1) << slots) - 1;
+}
+
+inline int slot_count(slot_mask_t mask) {
+    return __builtin_popcount(mask);
+}
+
+// mask 中最低的置位槽位；mask 不能为 0
+inline int lowest_slot(slot_mask_t mask) {
+    return __builtin_ctz(mask);
+}
+
+// mask 中第 k 个（从 0 起）置位的槽位，不存在时返回 -1；有 BMI2 时用 pdep 直接选出
+inline int select_slot(slot_mask_t mask, uint32_t k) {
+    if (k >= static_cast<uint32_t>(slot_count(mask))) {
+        return -1;
+    }
+#ifdef __BMI2__
+    return __builtin_ctz(__builtin_ia32_pdep_si(1u << k, mask));
+#else
+    for (uint32_t i = 0; i < k; i++) {
+        mask &= mask - 1;
+    }
+    return __builtin_ctz(mask);
+#endif
+}
 
 class bucket
 {
@@ -13,15 +74,33 @@ public:
 	//桶被访问次数
 	int count;
 
-	//记录offset
-	vector<int> ptrs;
+	//记录offset：每个槽位装的块号，-1 为 dummy 槽位（只有前 Z+S 项有意义）
+	std::array<int32_t, MAX_BUCKET_SLOTS> ptrs;
+
+	//有效位：第 i 位为 1 表示第 i 个槽位有效，线格式与加密元数据按槽位展开成整数
+	slot_mask_t valid;
 
-	//记录有效位
-	vector<int> valids;
+	//dummy 块确定性密文的随机数，0 表示 dummy 块没有数据（XOR 读路径使用）；整桶密封时为载荷的 nonce
+	uint64_t nonce;
+
+	//整桶密封：载荷的 GCM 标签，以及每个槽位明文的摘要（单槽读取时校验，dummy 槽位为 0）
+	uint8_t tag[16];
+	std::array<uint64_t, MAX_BUCKET_SLOTS> digests;
 
 	bucket();
 	bucket(int Z, int S);
 
+	int slots() const { return Z + S; }
+	bool is_valid(int i) const { return (valid >> i) & 1; }
+	void set_valid(int i, bool is_valid);
+
+	//不装真实块（ptr 为 -1）的槽位，由 ptrs 算出
+	slot_mask_t dummy_slots() const;
+	//有效的 dummy 槽位（ptr 为 -1 且有效）
+	slot_mask_t dummy_mask() const { return valid & dummy_slots(); }
+	//有效且装有真实块的槽位
+	slot_mask_t live_mask() const { return valid & ~dummy_slots(); }
+
 	//随机获取dummyblock的offset
 	int GetDummyblockOffset() const;
 };
\ No newline at end of file
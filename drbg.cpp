@@ -0,0 +1,93 @@
+#include "drbg.h"
+#include <sgx_trts.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+Drbg& Drbg::global() {
+    static Drbg instance;
+    return instance;
+}
+
+Drbg::Drbg() : used(kBufferSize), refills(0), seeded(false) {
+}
+
+void Drbg::reseed() {
+    uint8_t seed[sizeof(key) + sizeof(counter)];
+    if (sgx_read_rand(seed, sizeof(seed)) != SGX_SUCCESS) {
+        throw std::runtime_error("sgx_read_rand failed while seeding the DRBG");
+    }
+    memcpy(&key, seed, sizeof(key));
+    memcpy(counter, seed + sizeof(key), sizeof(counter));
+    refills = 0;
+    seeded = true;
+}
+
+void Drbg::refill() {
+    if (!seeded || refills >= kReseedInterval) {
+        reseed();
+    }
+
+    // 缓冲区之后再生成 32 字节作为下一轮的密钥和计数器，已输出的字节无法由之后的状态倒推
+    static const uint8_t zeros[kBufferSize] = { 0 };
+    uint8_t next_state[sizeof(key) + sizeof(counter)];
+    if (sgx_aes_ctr_encrypt(&key, zeros, kBufferSize, counter, 128, buffer) != SGX_SUCCESS
+        || sgx_aes_ctr_encrypt(&key, zeros, sizeof(next_state), counter, 128, next_state) != SGX_SUCCESS) {
+        throw std::runtime_error("DRBG refill failed");
+    }
+    memcpy(&key, next_state, sizeof(key));
+    memcpy(counter, next_state + sizeof(key), sizeof(counter));
+    memset(next_state, 0, sizeof(next_state));
+
+    used = 0;
+    refills++;
+}
+
+void Drbg::take(uint8_t* out, size_t length) {
+    while (length > 0) {
+        if (used == kBufferSize) {
+            refill();
+        }
+        size_t n = std::min(length, kBufferSize - used);
+        memcpy(out, buffer + used, n);
+        // 取出的字节从缓冲区抹掉
+        memset(buffer + used, 0, n);
+        used += n;
+        out += n;
+        length -= n;
+    }
+}
+
+void Drbg::generate(uint8_t* out, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    take(out, length);
+}
+
+uint32_t Drbg::next_u32() {
+    uint32_t value;
+    generate(reinterpret_cast<uint8_t*>(&value), sizeof(value));
+    return value;
+}
+
+uint64_t Drbg::next_u64() {
+    uint64_t value;
+    generate(reinterpret_cast<uint8_t*>(&value), sizeof(value));
+    return value;
+}
+
+uint32_t Drbg::uniform(uint32_t bound) {
+    if (bound <= 1) {
+        return 0;
+    }
+
+    // 丢弃落在 2^32 对 bound 取余的尾部区间的值
+    uint32_t threshold = static_cast<uint32_t>(-bound) % bound;
+    std::lock_guard<std::mutex> lock(mutex);
+    while (true) {
+        uint32_t value;
+        take(reinterpret_cast<uint8_t*>(&value), sizeof(value));
+        if (value >= threshold) {
+            return value % bound;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <sgx_tcrypto.h>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+// Enclave 内统一的随机数源：AES-128-CTR DRBG，由 sgx_read_rand 播种一次，
+// 每次输出一整块缓冲区的随机字节，之后逐字取用；每次填充后用额外的密钥流更新密钥与计数器（前向安全），
+// 填充一定次数后从 sgx_read_rand 重新播种。位置图初始化、洗牌、dummy 选择和随机路径都从这里取数
+class Drbg
+{
+public:
+    static Drbg& global();
+
+    void generate(uint8_t* out, size_t length);
+    uint32_t next_u32();
+    uint64_t next_u64();
+    // [0, bound) 上的均匀整数（拒绝采样，无取模偏差）；bound 为 0 时返回 0
+    uint32_t uniform(uint32_t bound);
+
+private:
+    static const size_t kBufferSize = 4096;
+    static const uint32_t kReseedInterval = 1 << 16;   // 重新播种前的填充次数
+
+    std::mutex mutex;
+    sgx_aes_ctr_128bit_key_t key;
+    uint8_t counter[16];
+    uint8_t buffer[kBufferSize];
+    size_t used;
+    uint32_t refills;
+    bool seeded;
+
+    Drbg();
+    void reseed();
+    void refill();
+    void take(uint8_t* out, size_t length);
+};
@@ -1,7 +1,11 @@
 #include "param.h"
+#include "bucket.h"
 #include <cmath>
+#include <cstdint>
 #include<cstring>
 #include<string>
+#include <stdexcept>
+#include <algorithm>
 
 int totalnumRealblock = 2000000;
 int OramL = static_cast<int>(ceil(log2(totalnumRealblock)));
@@ -18,4 +22,144 @@ block dummyBlock(-1, -1, {});
 int maxblockEachbkt = realBlockEachbkt + dummyBlockEachbkt;
 
 int cacheLevel = (OramL/2);
-int nodes_load=k;
\ No newline at end of file
+int nodes_load=k;
+
+int switchlessWorkers = 2;
+bool xorReadPath = false;
+int posMapMode = POSMAP_FLAT;
+bool backgroundEviction = false;
+int evictionBacklog = 8;
+int evictionPaths = 1;
+bool evictionPrefetch = false;
+bool bucketSealing = false;
+bool bulkLoadSkipEmpty = false;
+
+// 与 ringoram 中的格式一致：每块加密后多出 kBlockCryptoOverhead，元数据为 3 个定长字段加每槽位 3 个字段，
+// 整桶密封时另有 4 个字段的标签和每槽位 2 个字段的摘要
+static const size_t kMetadataFields = 3;
+static const size_t kMetadataFieldsPerSlot = 3;
+static const size_t kSealedMetadataFields = 4;
+static const size_t kSealedMetadataFieldsPerSlot = 2;
+
+static int levelsFor(int n) {
+    return n > 1 ? static_cast<int>(ceil(log2(n))) : 0;
+}
+
+OramConfig currentOramConfig() {
+    OramConfig config;
+    memset(&config, 0, sizeof(config));
+    config.totalnumRealblock = totalnumRealblock;
+    config.realBlockEachbkt = realBlockEachbkt;
+    config.dummyBlockEachbkt = dummyBlockEachbkt;
+    config.EvictRound = EvictRound;
+    config.blocksize = blocksize;
+    config.cacheLevel = cacheLevel;
+    config.posMapMode = posMapMode;
+    config.evictionPaths = evictionPaths;
+    config.xorReadPath = xorReadPath ? 1 : 0;
+    config.bucketSealing = bucketSealing ? 1 : 0;
+    config.evictionPrefetch = evictionPrefetch ? 1 : 0;
+    config.bulkLoadSkipEmpty = bulkLoadSkipEmpty ? 1 : 0;
+    return config;
+}
+
+bool bucketFitsLimits(const OramConfig& config) {
+    // 一个桶的序列化结果与加密元数据必须放得进各自的定长槽
+    size_t slots = config.realBlockEachbkt + config.dummyBlockEachbkt;
+    size_t bucket_bytes = sizeof(SerializedBucketHeader) + 2 * slots * sizeof(int32_t)
+        + slots * (sizeof(SerializedBlockHeader) + config.blocksize + kBlockCryptoOverhead);
+    size_t fields = kMetadataFields + kMetadataFieldsPerSlot * slots;
+    if (config.bucketSealing) {
+        fields += kSealedMetadataFields + kSealedMetadataFieldsPerSlot * slots;
+    }
+    size_t metadata_bytes = fields * sizeof(int32_t) + kBlockCryptoOverhead;
+    return bucket_bytes <= MAX_SERIALIZED_BUCKET_SIZE && metadata_bytes <= MAX_BUCKET_METADATA_SIZE
+        && slots <= static_cast<size_t>(MAX_BUCKET_SLOTS);
+}
+
+void applyOramConfig(const OramConfig& config) {
+    if (config.totalnumRealblock <= 0 || config.realBlockEachbkt <= 0 || config.dummyBlockEachbkt <= 0
+        || config.EvictRound <= 0 || config.blocksize <= 0 || config.evictionPaths <= 0) {
+        throw std::runtime_error("ORAM config: sizes and counts must be positive");
+    }
+    if (config.posMapMode < POSMAP_FLAT || config.posMapMode > POSMAP_COMPRESSED) {
+        throw std::runtime_error("ORAM config: unknown position map mode");
+    }
+    // 递归位置图的每个内层块至少要放下一个叶子号
+    if (config.posMapMode == POSMAP_RECURSIVE && config.blocksize < static_cast<int>(sizeof(int32_t))) {
+        throw std::runtime_error("ORAM config: blocksize too small for the recursive position map");
+    }
+
+    // 桶数 2^(levels+1) - 1 必须放得进 int
+    int levels = levelsFor(config.totalnumRealblock);
+    if (levels > kMaxOramLevels) {
+        throw std::runtime_error("ORAM config: tree too large");
+    }
+    if (config.cacheLevel < 0 || config.cacheLevel > levels + 1) {
+        throw std::runtime_error("ORAM config: cacheLevel out of range");
+    }
+
+    if (!bucketFitsLimits(config)) {
+        throw std::runtime_error("ORAM config: bucket does not fit the serialization limits");
+    }
+
+    totalnumRealblock = config.totalnumRealblock;
+    realBlockEachbkt = config.realBlockEachbkt;
+    dummyBlockEachbkt = config.dummyBlockEachbkt;
+    EvictRound = config.EvictRound;
+    blocksize = config.blocksize;
+    cacheLevel = config.cacheLevel;
+    posMapMode = config.posMapMode;
+    evictionPaths = config.evictionPaths;
+    xorReadPath = config.xorReadPath != 0;
+    bucketSealing = config.bucketSealing != 0;
+    evictionPrefetch = config.evictionPrefetch != 0;
+    bulkLoadSkipEmpty = config.bulkLoadSkipEmpty != 0;
+
+    OramL = levels;
+    numLeaves = 1 << OramL;
+    capacity = (1 << (OramL + 1)) - 1;
+    maxblockEachbkt = realBlockEachbkt + dummyBlockEachbkt;
+}
+
+bool sameOramConfig(const OramConfig& a, const OramConfig& b) {
+    return memcmp(&a, &b, sizeof(OramConfig)) == 0;
+}
+
+int posMapEntriesPerBlock() {
+    return blocksize / static_cast<int>(sizeof(int32_t));
+}
+
+int posMapInnerBlocks(int n) {
+    int per_block = posMapEntriesPerBlock();
+    return (n + per_block - 1) / per_block;
+}
+
+int posMapTreeBuckets(int n) {
+    if (posMapMode != POSMAP_RECURSIVE || n <= 0) {
+        return 0;
+    }
+    int levels = static_cast<int>(ceil(log2(posMapInnerBlocks(n))));
+    return (1 << (levels + 1)) - 1;
+}
+
+static int treeBuckets(int n) {
+    int levels = static_cast<int>(ceil(log2(n)));
+    return (1 << (levels + 1)) - 1;
+}
+
+int oramRegionBuckets(int n) {
+    int buckets = treeBuckets(n);
+    if (posMapEntriesPerBlock() > 0) {
+        buckets += treeBuckets(posMapInnerBlocks(n));
+    }
+    return buckets;
+}
+
+int storageTestBlocks(int n) {
+    return std::max(2, std::min(1024, n / 4));
+}
+
+int storageTestBuckets(int n) {
+    return kStorageTestTrees * oramRegionBuckets(storageTestBlocks(n));
+}
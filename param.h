@@ -4,13 +4,14 @@
 #include"block.h"
 #include<vector>
 #include<string>
+#include<cstdint>
 
 
 /*
  * param.h
  * ----------------------------------------
  * 本文件定义了 ORAM 系统中的全局参数。
- * 这些参数会在 param.cpp 中被初始化。
+ * 这些参数会在 param.cpp 中被初始化，决定树形的参数可在运行时经 OramConfig 整体替换。
  */
 
  // ORAM 系统中真实数据块的总数量
@@ -47,4 +48,87 @@ extern int cacheLevel;
 
 extern int nodes_load;
 
+// Host 端处理 switchless OCALL 的 worker 线程数，0 表示使用普通 OCALL
+extern int switchlessWorkers;
+
+// ReadPath 是否使用 XOR 压缩：dummy 块确定性加密，Host 将每层选中的块异或成一个块返回
+extern bool xorReadPath;
+
+// 位置图的实现方式
+enum PositionMapMode {
+    POSMAP_FLAT = 0,        // Enclave 内每块一个 int 叶子号
+    POSMAP_RECURSIVE = 1,   // 叶子号打包存入一棵较小的 Ring ORAM（放在 Host），Enclave 只保留其位置图
+    POSMAP_COMPRESSED = 2   // 每块一个 8 位计数器加每组一个 64 位计数器，叶子号由 PRF 派生
+};
+extern int posMapMode;
+
+// 是否把 EvictPath/EarlyReshuffle 交给 Enclave 内的后台驱逐线程，前台访问拿到目标块即返回
+extern bool backgroundEviction;
+// 后台驱逐队列的上限，超出时由前台线程就地执行最早的任务，以此限制 stash 的增长
+extern int evictionBacklog;
+
+// 每次驱逐一起处理的连续驱逐路径数 k：读入 k 条路径的桶并集、整棵子树上贪心放置 stash 中的块、
+// 每个桶只写回一次；驱逐频率不变（每 k * EvictRound 次访问驱逐 k 条路径）。Host 暂存区按此放大
+extern int evictionPaths;
+
+// 驱逐路径预取：驱逐按反向字典序进行、与数据无关，每次驱逐时 Enclave 把下一批驱逐路径告知 Host，
+// Host 的预取线程在前台查询期间把这些桶调入内存。只对映射自桶文件的 LAYOUT_MMAP 有用，默认关闭；
+// 其他布局下 Host 不启动预取线程，忽略收到的提示
+extern bool evictionPrefetch;
+
+// 整桶密封：每个桶的载荷区（所有槽位，dummy 也是定长密文）作为一个 AES-GCM 消息加密，只有一个 IV 和标签，
+// 所有桶大小相同；标签与各槽位明文摘要存入桶元数据，单槽读取时用摘要校验。关闭时每个真实块单独加密
+extern bool bucketSealing;
+
+// 批量装载时不写出全空的桶：初始叶子随机选取、与数据无关，哪些桶为空不泄露数据内容，
+// 未写过的桶在 Host 上本来就是全 dummy 的空桶。配合 LAYOUT_SPARSE 时 Host 只为装了块的桶分配内存；默认关闭
+extern bool bulkLoadSkipEmpty;
+
+// 逐块 AES-GCM 加密后每块多出的 IV(12) + MAC(16)，Host 按它为槽位预留空间（与 SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE 相同）
+const size_t kBlockCryptoOverhead = 12 + 16;
+
+// 决定树形与存储格式的运行时参数。Host 与 Enclave 各有一份全局参数，
+// 由 SGXEnclaveWrapper::configure 在两侧分别应用（ecall_oram_configure），并校验 Enclave 应用后的结果与 Host 一致。
+// 只含定长整数，按字节经 ECALL 传入 Enclave
+struct OramConfig {
+    int32_t totalnumRealblock;
+    int32_t realBlockEachbkt;
+    int32_t dummyBlockEachbkt;
+    int32_t EvictRound;
+    int32_t blocksize;
+    int32_t cacheLevel;
+    int32_t posMapMode;
+    int32_t evictionPaths;
+    int32_t xorReadPath;
+    int32_t bucketSealing;
+    int32_t evictionPrefetch;
+    int32_t bulkLoadSkipEmpty;
+};
+
+// 树高 OramL 的上限：树的桶数 2^(OramL+1) - 1 须放得进 int
+const int kMaxOramLevels = 29;
+
+// 当前全局参数组成的配置
+OramConfig currentOramConfig();
+// 校验并应用配置，同时重新计算 OramL、numLeaves、capacity、maxblockEachbkt；参数非法时抛出 runtime_error
+void applyOramConfig(const OramConfig& config);
+// 桶的序列化结果与加密元数据（含整桶密封字段）是否放得进定长槽
+bool bucketFitsLimits(const OramConfig& config);
+bool sameOramConfig(const OramConfig& a, const OramConfig& b);
+
+// 递归位置图中每个块可容纳的叶子号个数，以及 n 个块需要的内层 ORAM 块数和桶数
+// Host 按 posMapTreeBuckets 在主树之后为内层树预留存储，非递归模式下为 0
+int posMapEntriesPerBlock();
+int posMapInnerBlocks(int n);
+int posMapTreeBuckets(int n);
+
+// n 块的 ORAM 在任一位置图模式下占用的桶数上限（主树加递归位置图的内层树）
+int oramRegionBuckets(int n);
+
+// ecall_test_ringoram_storage 的测试树：共 kStorageTestTrees 棵，每棵至多 storageTestBlocks(n) 块，
+// 依次放在主树与位置图树之后，互不重叠；Host 运行该测试前按 storageTestBuckets(n) 多预留存储
+const int kStorageTestTrees = 7;
+int storageTestBlocks(int n);
+int storageTestBuckets(int n);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "payload_pool.h"
+#include "param.h"
+#include <sgx_tcrypto.h>
+#include <algorithm>
+
+PayloadPool& PayloadPool::global() {
+    static PayloadPool instance;
+    return instance;
+}
+
+PayloadPool::PayloadPool() : slab_size(0), counters{0, 0, 0, 0, 0} {
+}
+
+// 逐块 GCM 密文（IV | 数据 | MAC）与整桶密封的槽位（round16(4 + blocksize)）都放得下
+void PayloadPool::refresh_slab_size() {
+    size_t block_bytes = blocksize > 0 ? static_cast<size_t>(blocksize) : 0;
+    size_t gcm_bytes = block_bytes + SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE;
+    size_t sealed_bytes = (sizeof(uint32_t) + block_bytes + 15) / 16 * 16;
+    size_t wanted = std::max(gcm_bytes, sealed_bytes);
+    if (wanted == slab_size) {
+        return;
+    }
+
+    // 旧大小的 slab 归还时容量不符，直接释放；统计从新的 slab 大小重新开始
+    free_slabs.clear();
+    counters = Stats{0, 0, 0, 0, 0};
+    slab_size = wanted;
+}
+
+vector<char> PayloadPool::acquire(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    refresh_slab_size();
+    if (size > slab_size) {
+        counters.oversize++;
+        return vector<char>(size);
+    }
+
+    vector<char> buffer;
+    if (!free_slabs.empty()) {
+        buffer = std::move(free_slabs.back());
+        free_slabs.pop_back();
+        counters.reused++;
+    } else {
+        buffer.reserve(slab_size);
+    }
+    buffer.resize(size);
+    counters.acquired++;
+    return buffer;
+}
+
+void PayloadPool::release(vector<char>&& buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (buffer.capacity() != slab_size || slab_size == 0) {
+        vector<char>().swap(buffer);
+        return;
+    }
+    buffer.clear();
+    free_slabs.push_back(std::move(buffer));
+    counters.released++;
+}
+
+size_t PayloadPool::slab_bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    refresh_slab_size();
+    return slab_size;
+}
+
+PayloadPool::Stats PayloadPool::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = counters;
+    result.free_slabs = free_slabs.size();
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Enclave 内块载荷的定长缓冲池：每个 slab 是容量为 blocksize + 加密开销的 vector<char>，
+// 桶读入的密文、解密后放入 stash 的明文、写回前的密文都从这里取，用完归还后复用，
+// 驱逐过程不再反复在可信堆上分配和释放。超出 slab 大小的请求直接走堆，不入池。
+// 池不记录 slab 的归属：归还的缓冲区只要容量恰为 slab 大小就进入空闲链表（来源不影响复用），
+// 其他缓冲区（扩容过的 slab、调用方的数据）直接释放。统计只计 acquire/release 的调用次数
+class PayloadPool
+{
+public:
+    struct Stats {
+        uint64_t acquired;     // 从池中取出（不超过 slab 大小）的次数
+        uint64_t released;     // 归还后进入空闲链表的次数
+        uint64_t reused;       // 取自空闲链表（未分配）的次数
+        uint64_t oversize;     // 超出 slab 大小、直接走堆的请求数
+        uint64_t free_slabs;   // 当前空闲链表中的 slab 数
+    };
+
+    static PayloadPool& global();
+
+    // 长度为 size 的缓冲区（内容未初始化）；size 不超过 slab 大小时来自池中
+    vector<char> acquire(size_t size);
+    // 归还缓冲区：容量为 slab 大小的回到空闲链表，其他缓冲区直接释放
+    void release(vector<char>&& buffer);
+
+    size_t slab_bytes();
+    Stats stats();
+
+private:
+    std::mutex mutex;
+    size_t slab_size;
+    vector<vector<char>> free_slabs;
+    Stats counters;
+
+    PayloadPool();
+    // blocksize 改变后丢弃旧的空闲 slab，调用方持有 mutex
+    void refresh_slab_size();
+};
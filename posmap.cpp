@@ -0,0 +1,205 @@
+#include "SGXEnclave_t.h"
+#include "posmap.h"
+#include "ringoram.h"
+#include "param.h"
+#include "drbg.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <sgx_trts.h>
+
+// 均匀随机的叶子号（平坦位置图初始化时每块取一次，取自 DRBG 的缓冲区）
+static int random_leaf(int num_leaves) {
+    if (num_leaves <= 0) {
+        return 0;
+    }
+    return (int)Drbg::global().uniform(static_cast<uint32_t>(num_leaves));
+}
+
+std::unique_ptr<PositionMap> make_position_map(int mode, ringoram& owner) {
+    switch (mode) {
+        case POSMAP_RECURSIVE:
+            return std::unique_ptr<PositionMap>(new RecursivePositionMap(owner));
+        case POSMAP_COMPRESSED:
+            return std::unique_ptr<PositionMap>(new CompressedPositionMap(owner.N, owner.num_leaves));
+        case POSMAP_FLAT:
+            return std::unique_ptr<PositionMap>(new FlatPositionMap(owner.N, owner.num_leaves));
+        default:
+            throw std::runtime_error("Unknown position map mode");
+    }
+}
+
+void PositionMap::bulk_assign(const vector<int>& blockindices, vector<int>& leaves) {
+    leaves.clear();
+    leaves.reserve(blockindices.size());
+    vector<Relocation> relocations;
+    for (int blockindex : blockindices) {
+        int new_leaf = 0;
+        remap(blockindex, new_leaf, relocations);
+        if (!relocations.empty()) {
+            throw std::runtime_error("Position map relocated blocks during a bulk load");
+        }
+        leaves.push_back(new_leaf);
+    }
+}
+
+// ================================
+// FlatPositionMap
+// ================================
+
+FlatPositionMap::FlatPositionMap(int n, int num_leaves)
+    : num_leaves(num_leaves), leaves(n) {
+    for (int i = 0; i < n; i++) {
+        leaves[i] = random_leaf(num_leaves);
+    }
+}
+
+int FlatPositionMap::remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) {
+    int old_leaf = leaves[blockindex];
+    new_leaf = random_leaf(num_leaves);
+    leaves[blockindex] = new_leaf;
+    return old_leaf;
+}
+
+// ================================
+// RecursivePositionMap
+// ================================
+
+RecursivePositionMap::RecursivePositionMap(ringoram& owner)
+    : owner(owner), entries_per_block(posMapEntriesPerBlock()) {
+    if (entries_per_block <= 0) {
+        throw std::runtime_error("Block size too small for a recursive position map");
+    }
+
+    // 内层树紧跟在外层树之后；内层自身使用平坦位置图，递归只有一层
+    int inner_blocks = posMapInnerBlocks(owner.N);
+    int inner_levels = static_cast<int>(ceil(log2(inner_blocks)));
+    inner.reset(new ringoram(inner_blocks, inner_levels / 2, POSMAP_FLAT,
+                             owner.tree_base + owner.num_bucket));
+}
+
+RecursivePositionMap::~RecursivePositionMap() = default;
+
+int RecursivePositionMap::remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) {
+    // 外层在构造之后才设置加密工具，内层与外层共用
+    inner->enclave_crypto = owner.enclave_crypto;
+
+    new_leaf = random_leaf(owner.num_leaves);
+    int slot = blockindex % entries_per_block;
+    int32_t old_leaf = -1;
+
+    // 一次内层访问完成读旧叶子、写新叶子
+    inner->update(blockindex / entries_per_block, [&](vector<char>& data) {
+        if (data.size() != static_cast<size_t>(entries_per_block) * sizeof(int32_t)) {
+            // 全 0xff 即每项为 -1（未分配）
+            data.assign(static_cast<size_t>(entries_per_block) * sizeof(int32_t), static_cast<char>(0xff));
+        }
+        int32_t* entries = reinterpret_cast<int32_t*>(data.data());
+        old_leaf = entries[slot];
+        entries[slot] = new_leaf;
+    });
+
+    if (old_leaf < 0 || old_leaf >= owner.num_leaves) {
+        return random_leaf(owner.num_leaves);
+    }
+    return old_leaf;
+}
+
+void RecursivePositionMap::bulk_assign(const vector<int>& blockindices, vector<int>& leaves) {
+    inner->enclave_crypto = owner.enclave_crypto;
+
+    // 同一内层块的项打包在一起，未装载的项保持 -1（全 0xff）
+    size_t block_bytes = static_cast<size_t>(entries_per_block) * sizeof(int32_t);
+    std::map<int, vector<char>> packed;
+    leaves.clear();
+    leaves.reserve(blockindices.size());
+    for (int blockindex : blockindices) {
+        int leaf = random_leaf(owner.num_leaves);
+        leaves.push_back(leaf);
+        vector<char>& data = packed[blockindex / entries_per_block];
+        if (data.empty()) {
+            data.assign(block_bytes, static_cast<char>(0xff));
+        }
+        int32_t entry = leaf;
+        memcpy(data.data() + (blockindex % entries_per_block) * sizeof(int32_t), &entry, sizeof(entry));
+    }
+
+    vector<pair<int, vector<char>>> inner_blocks;
+    inner_blocks.reserve(packed.size());
+    for (auto& p : packed) {
+        inner_blocks.emplace_back(p.first, std::move(p.second));
+    }
+    inner->bulk_load(inner_blocks);
+}
+
+size_t RecursivePositionMap::enclave_bytes() const {
+    return inner->posmap->enclave_bytes() + inner->bucket_counts.size()
+        + inner->tree_top.size() * (sizeof(bucket) + realBlockEachbkt * static_cast<size_t>(blocksize));
+}
+
+// ================================
+// CompressedPositionMap
+// ================================
+
+CompressedPositionMap::CompressedPositionMap(int n, int num_leaves)
+    : n(n), num_leaves(num_leaves), counters(n, 0),
+      group_counters((n + kGroupSize - 1) / kGroupSize, 0) {
+    if (sgx_read_rand(key, sizeof(key)) != SGX_SUCCESS) {
+        throw std::runtime_error("Failed to generate position map key");
+    }
+}
+
+int CompressedPositionMap::leaf_of(int blockindex) const {
+    if (num_leaves <= 1) {
+        return 0;
+    }
+
+    // PRF 输入：块号(4) | 组计数器(8) | 块计数器(1)
+    uint8_t msg[13];
+    int32_t index = blockindex;
+    memcpy(msg, &index, sizeof(index));
+    memcpy(msg + 4, &group_counters[blockindex / kGroupSize], sizeof(uint64_t));
+    msg[12] = counters[blockindex];
+
+    sgx_cmac_128bit_tag_t tag;
+    if (sgx_rijndael128_cmac_msg(&key, msg, sizeof(msg), &tag) != SGX_SUCCESS) {
+        throw std::runtime_error("Position map PRF failed");
+    }
+    uint32_t value;
+    memcpy(&value, tag, sizeof(value));
+    return (int)(value % static_cast<uint32_t>(num_leaves));
+}
+
+int CompressedPositionMap::remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) {
+    int old_leaf = leaf_of(blockindex);
+
+    if (counters[blockindex] < UINT8_MAX) {
+        counters[blockindex]++;
+        new_leaf = leaf_of(blockindex);
+        return old_leaf;
+    }
+
+    // 块计数器溢出：整组换新的组计数器，组内其他块的叶子随之改变，需要搬移
+    int group = blockindex / kGroupSize;
+    int first = group * kGroupSize;
+    int last = std::min(n, first + kGroupSize);
+    vector<int> old_leaves(last - first);
+    for (int i = first; i < last; i++) {
+        old_leaves[i - first] = leaf_of(i);
+    }
+
+    group_counters[group]++;
+    for (int i = first; i < last; i++) {
+        counters[i] = 0;
+    }
+
+    for (int i = first; i < last; i++) {
+        if (i != blockindex) {
+            relocations.push_back({i, old_leaves[i - first], leaf_of(i)});
+        }
+    }
+    new_leaf = leaf_of(blockindex);
+    return old_leaf;
+}
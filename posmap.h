@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <sgx_tcrypto.h>
+
+using namespace std;
+
+class ringoram;
+class EnclaveCryptoUtils;
+
+// 位置图：块号 -> 叶子号。每次访问取出块的旧叶子并为它分配新叶子
+class PositionMap
+{
+public:
+    // 位置图自身改变了其他块的叶子时（压缩模式的组计数器溢出），ringoram 需要把这些块搬到新路径
+    struct Relocation {
+        int blockindex;
+        int old_leaf;
+        int new_leaf;
+    };
+
+    virtual ~PositionMap() = default;
+
+    // 返回块当前的叶子，new_leaf 返回新分配的叶子；需要额外搬移的块追加到 relocations
+    virtual int remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) = 0;
+
+    // 批量装载：为一组从未访问过的块（各不相同）分配初始叶子，按顺序写入 leaves。默认逐块调用 remap
+    virtual void bulk_assign(const vector<int>& blockindices, vector<int>& leaves);
+
+    // 会产生搬移的位置图返回 k > 0：ringoram 每 k 次访问固定多做一次搬移形状的路径读取，
+    // k 须保证搬移的产生速度不超过 1/k，待搬移的块才有上界
+    virtual int relocation_interval() const { return 0; }
+
+    // 常驻 Enclave 的字节数（估计值，用于日志）
+    virtual size_t enclave_bytes() const = 0;
+};
+
+// 按 mode（PositionMapMode）创建位置图；owner 为使用该位置图的 ringoram
+std::unique_ptr<PositionMap> make_position_map(int mode, ringoram& owner);
+
+// Enclave 内每块一个叶子号（原实现）
+class FlatPositionMap : public PositionMap
+{
+public:
+    FlatPositionMap(int n, int num_leaves);
+
+    int remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) override;
+    size_t enclave_bytes() const override { return leaves.size() * sizeof(int); }
+
+private:
+    int num_leaves;
+    vector<int> leaves;
+};
+
+// 递归位置图：叶子号每 posMapEntriesPerBlock() 个打包成一块，存入放在 Host 的内层 Ring ORAM
+// （位于主树之后），Enclave 只保留内层 ORAM 的平坦位置图和 stash。
+// 尚未分配过的叶子号记为 -1，首次访问时读一条随机路径
+class RecursivePositionMap : public PositionMap
+{
+public:
+    RecursivePositionMap(ringoram& owner);
+    ~RecursivePositionMap();
+
+    int remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) override;
+    // 叶子号直接打包成内层块，整体批量装入内层树，不逐个访问内层 ORAM
+    void bulk_assign(const vector<int>& blockindices, vector<int>& leaves) override;
+    size_t enclave_bytes() const override;
+
+private:
+    ringoram& owner;
+    int entries_per_block;
+    std::unique_ptr<ringoram> inner;
+};
+
+// 压缩位置图：每 kGroupSize 个块共享一个 64 位组计数器，每块一个 8 位计数器，
+// 叶子号 = PRF(key, 块号, 组计数器, 块计数器) mod num_leaves。
+// 块计数器溢出时组计数器加一、组内计数器清零，组内其他块都换了叶子，需要搬移。
+// 若在溢出的那次访问里一次搬完，Host 会看到 kGroupSize 条路径的突发，恰好暴露某块被访问了 256 次；
+// 因此 ringoram 把搬移排队，每 relocation_interval() 次访问固定做一次（没有待搬移的块时读一条随机路径）。
+// 每次溢出至少要组内 256 次 remap、最多产生 kGroupSize - 1 个搬移，搬移速度低于 1/4
+class CompressedPositionMap : public PositionMap
+{
+public:
+    static const int kGroupSize = 64;
+
+    CompressedPositionMap(int n, int num_leaves);
+
+    int remap(int blockindex, int& new_leaf, vector<Relocation>& relocations) override;
+    int relocation_interval() const override { return 4; }
+    size_t enclave_bytes() const override {
+        return counters.size() * sizeof(uint8_t) + group_counters.size() * sizeof(uint64_t);
+    }
+
+private:
+    int n;
+    int num_leaves;
+    sgx_cmac_128bit_key_t key;
+    vector<uint8_t> counters;
+    vector<uint64_t> group_counters;
+
+    int leaf_of(int blockindex) const;
+};
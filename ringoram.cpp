@@ -2,10 +2,15 @@
 #include "ringoram.h"
 #include <cstring>
 #include "CryptoUtil.h"
+#include "drbg.h"
+#include "payload_pool.h"
 #include "param.h"
 #include <cmath>
 #include <sgx_trts.h>
 #include <string.h>
+#include <unordered_map>
+#include <array>
+#include <algorithm>
 
   
 
@@ -13,40 +18,135 @@
 
 using namespace std;
 
-int ringoram::round = 0;
-int ringoram::G = 0;
+uint8_t* ringoram::staging_buffer = nullptr;
+std::recursive_mutex ringoram::storage_mutex;
+std::condition_variable_any ringoram::eviction_cv;
+std::deque<ringoram::EvictionTask> ringoram::eviction_queue;
+std::atomic<int> ringoram::foreground_waiting(0);
+bool ringoram::eviction_worker_running = false;
+bool ringoram::eviction_stop = false;
+
+// 前台访问持有 storage_mutex 的方式：加锁前登记等待，后台线程在当前任务结束后让出锁；
+// 释放锁时唤醒后台线程重新检查条件，否则前台不排队任务就返回（异常或提前返回）时队列中的任务无人处理
+namespace {
+class ForegroundLock
+{
+public:
+    ForegroundLock() {
+        ringoram::foreground_waiting++;
+        lock = std::unique_lock<std::recursive_mutex>(ringoram::storage_mutex);
+        ringoram::foreground_waiting--;
+    }
+    ~ForegroundLock() {
+        lock.unlock();
+        ringoram::eviction_cv.notify_one();
+    }
+
+private:
+    std::unique_lock<std::recursive_mutex> lock;
+};
+}
+
+// 必须与 SGXEnclave.config.xml 中的 HeapMaxSize 保持一致（修改配置文件时同步修改）。
+// 所有 ringoram 实例（g_oram、RingOramStorage 的 ORAM、递归位置图的内层 ORAM）的树顶缓存
+// 共用其中的四分之一，构造时从共享预算中预留，析构时归还
+static const size_t kEnclaveHeapBytes = 0x10000000;
+static const size_t kTreeTopBudgetBytes = kEnclaveHeapBytes / 4;
+static std::mutex tree_top_budget_mutex;
+static size_t tree_top_budget_used = 0;
+
+// 缓存前 levels 层（满载的明文桶）所需的堆内存估计
+static size_t tree_top_bytes(int levels) {
+    size_t buckets = (size_t(1) << levels) - 1;
+    size_t per_bucket = sizeof(bucket)
+        + realBlockEachbkt * static_cast<size_t>(blocksize)
+        + maxblockEachbkt * (sizeof(block) + 2 * sizeof(int));
+    return buckets * per_bucket;
+}
+size_t ringoram::staging_size = 0;
+
+sgx_status_t ringoram::set_staging_buffer(uint8_t* buffer, size_t size) {
+    // 暂存区必须完整位于 Enclave 之外，且至少能容纳一个桶
+    if (!buffer || size < MAX_SERIALIZED_BUCKET_SIZE || !sgx_is_outside_enclave(buffer, size)) {
+        return SGX_ERROR_INVALID_PARAMETER;
+    }
+    staging_buffer = buffer;
+    staging_size = size;
+    return SGX_SUCCESS;
+}
 
-ringoram::ringoram(int n, int cache_levels)
-    : N(n), L(static_cast<int>(ceil(log2(N)))), num_bucket((1 << (L + 1)) - 1), 
-      num_leaves(1 << L), cache_levels(cache_levels) {
+ringoram::ringoram(int n, int cache_levels, int posmap_mode, int tree_base)
+    : round(0), G(0), N(n), L(static_cast<int>(ceil(log2(N)))), num_bucket((1 << (L + 1)) - 1), 
+      num_leaves(1 << L), cache_levels(cache_levels), xor_read_path(xorReadPath), tree_base(tree_base),
+      background_eviction(backgroundEviction), eviction_paths(std::max(1, evictionPaths)),
+      bucket_sealing(bucketSealing), untouched(true), relocation_round(0) {
     
     c = 0;
-    positionmap = new int[N];
-    for (int i = 0; i < N; i++) {
-        positionmap[i] = get_random();
-    }
+    stash = Stash(L);
+    bucket_counts.assign(num_bucket, 0);
+    bucket_versions.assign(num_bucket, 0);
 
     // Enclave 内加密工具在 Enclave 初始化时设置
     enclave_crypto = nullptr;
 
+    posmap = make_position_map(posmap_mode, *this);
+
+    // 树顶缓存：前 cache_levels 层的桶以明文保存在 Enclave 内，共享预算剩余的部分放不下时减少层数
+    int requested_levels = this->cache_levels;
+    this->cache_levels = std::max(0, std::min(this->cache_levels, L + 1));
+    {
+        std::lock_guard<std::mutex> budget_lock(tree_top_budget_mutex);
+        size_t available = kTreeTopBudgetBytes - tree_top_budget_used;
+        while (this->cache_levels > 0 && tree_top_bytes(this->cache_levels) > available) {
+            this->cache_levels--;
+        }
+        tree_top_reserved = tree_top_bytes(this->cache_levels);
+        tree_top_budget_used += tree_top_reserved;
+    }
+    tree_top.assign((1 << this->cache_levels) - 1, bucket(realBlockEachbkt, dummyBlockEachbkt));
+
     char msg[100];
+    if (this->cache_levels < requested_levels) {
+        snprintf(msg, sizeof(msg), "Tree-top cache limited to %d of %d levels by the shared enclave heap budget",
+                 this->cache_levels, requested_levels);
+        ocall_print_string(msg);
+    }
+    if (posmap_mode != POSMAP_FLAT) {
+        snprintf(msg, sizeof(msg), "Position map mode %d keeps %zu bytes in the enclave for %d blocks",
+                 posmap_mode, posmap->enclave_bytes(), N);
+        ocall_print_string(msg);
+    }
 }
 
-// 使用 SGX 安全的随机数生成
+// 丢弃本实例尚未执行的后台任务；持锁时后台线程不会正在执行本实例的任务
+ringoram::~ringoram() {
+    std::lock_guard<std::recursive_mutex> lock(storage_mutex);
+    for (auto it = eviction_queue.begin(); it != eviction_queue.end();) {
+        if (it->oram == this) {
+            it = eviction_queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // 树顶缓存和 stash 持有的缓冲区归还载荷池，否则在池的统计中一直算作取出未还
+    for (auto& bkt : tree_top) {
+        recycle_bucket(bkt);
+    }
+    for (auto& blk : stash.take_all()) {
+        PayloadPool::global().release(blk.TakeData());
+    }
+
+    std::lock_guard<std::mutex> budget_lock(tree_top_budget_mutex);
+    tree_top_budget_used -= tree_top_reserved;
+}
+
+// 随机叶子，取自 Enclave 内的 DRBG
 int ringoram::get_random() {
     if (num_leaves <= 0) {
         return 0;
     }
-    
-    uint32_t random_value;
-    sgx_status_t ret = sgx_read_rand((uint8_t*)&random_value, sizeof(random_value));
-    
-    if (ret != SGX_SUCCESS) {
-        ocall_print_string("Warning: sgx_read_rand failed, using fallback");
-        
-    }
-    
-    return (int)(random_value % num_leaves);
+    return (int)Drbg::global().uniform(static_cast<uint32_t>(num_leaves));
 }
 
 int ringoram::Path_bucket(int leaf, int level) {
@@ -70,13 +170,14 @@ int ringoram::GetlevelFromPos(int pos) {
     return (int)floor(log2(pos + 1));
 }
 
-block ringoram::FindBlock(bucket bkt, int offset) const{
+const block& ringoram::FindBlock(const bucket& bkt, int offset) const{
     return bkt.blocks[offset];
 }
 
-int ringoram::GetBlockOffset(bucket bkt, int blockindex) const{
-    for (int i = 0; i < (realBlockEachbkt + dummyBlockEachbkt); i++) {
-        if (bkt.ptrs[i] == blockindex && bkt.valids[i] == 1) return i;
+int ringoram::GetBlockOffset(const bucket& bkt, int blockindex) const{
+    for (slot_mask_t live = bkt.live_mask(); live; live &= live - 1) {
+        int i = lowest_slot(live);
+        if (bkt.ptrs[i] == blockindex) return i;
     }
 
     return bkt.GetDummyblockOffset();
@@ -84,232 +185,1278 @@ int ringoram::GetBlockOffset(bucket bkt, int blockindex) const{
 
 void ringoram::ReadBucket(int pos) {
     
+    // 树顶缓存中的桶是明文，有效的真实块直接放入 stash
+    if (isPositionCached(pos)) {
+        bucket& bkt = tree_top[pos];
+        for (slot_mask_t live = bkt.live_mask(); live; live &= live - 1) {
+            // 槽位随即失效，数据直接移入 stash
+            int j = lowest_slot(live);
+            stash.insert(std::move(bkt.blocks[j]));
+            bkt.set_valid(j, false);
+        }
+        return;
+    }
+
     // 直接使用 SGX 方法读取
     bucket bkt = sgx_read_bucket(pos);
-    
-    for (int j = 0; j < maxblockEachbkt; j++) {
-		// 更严格的检查：只读取真实且有效的块
-		if (bkt.ptrs[j] != -1 && bkt.valids[j] && !bkt.blocks[j].IsDummy()) {
-			// 读取时解密
-			block encrypted_block = bkt.blocks[j];
-			vector<char> decrypted_data = decrypt_data(encrypted_block.GetData());
-			block decrypted_block(encrypted_block.GetLeafid(), encrypted_block.GetBlockindex(), decrypted_data);
-			stash.push_back(decrypted_block);
-		}
-	}
+    AbsorbBucket(bkt);
+}
+
+void ringoram::recycle_bucket(bucket& bkt) {
+    PayloadPool& pool = PayloadPool::global();
+    for (auto& blk : bkt.blocks) {
+        pool.release(blk.TakeData());
+    }
+}
+
+// 将桶中真实且有效的块解密后放入 stash，明文缓冲区取自载荷池
+void ringoram::AbsorbBucket(bucket& bkt) {
+    // 真实且有效的槽位
+    slot_mask_t live = bkt.live_mask();
+    if (!enclave_crypto) {
+        for (; live; live &= live - 1) {
+            stash.insert(std::move(bkt.blocks[lowest_slot(live)]));
+        }
+        return;
+    }
+
+    if (sealing_enabled()) {
+        // 整桶密封：校验整个载荷的标签后取出真实且有效的块；从未写过的空桶没有真实块
+        if (live == 0) {
+            recycle_bucket(bkt);
+            return;
+        }
+
+        size_t slot_size = sealed_slot_size();
+        vector<uint8_t> payload(slot_size * maxblockEachbkt);
+        for (int j = 0; j < maxblockEachbkt; j++) {
+            const vector<char>& data = bkt.blocks[j].GetData();
+            if (data.size() != slot_size) {
+                throw std::runtime_error("Sealed bucket has a slot of unexpected size");
+            }
+            memcpy(payload.data() + j * slot_size, data.data(), slot_size);
+        }
+        vector<uint8_t> plain(payload.size());
+        if (enclave_crypto->open_payload(bkt.nonce, payload.data(), payload.size(),
+                                         reinterpret_cast<const sgx_aes_gcm_128bit_tag_t*>(bkt.tag),
+                                         plain.data()) != SGX_SUCCESS) {
+            ocall_print_string("[DECRYPT] ERROR: sealed bucket failed authentication");
+            throw std::runtime_error("Bucket decryption failed");
+        }
+
+        for (; live; live &= live - 1) {
+            int j = lowest_slot(live);
+            const uint8_t* slot = plain.data() + j * slot_size;
+            uint32_t length;
+            memcpy(&length, slot, sizeof(length));
+            if (length > slot_size - sizeof(length)) {
+                throw std::runtime_error("Sealed slot has an invalid length");
+            }
+            vector<char> data = PayloadPool::global().acquire(length);
+            memcpy(data.data(), slot + sizeof(length), length);
+            stash.insert(block(bkt.blocks[j].GetLeafid(), bkt.blocks[j].GetBlockindex(), std::move(data)));
+        }
+        recycle_bucket(bkt);
+        return;
+    }
+
+    // 更严格的检查：只读取真实且有效的块；整桶的块一次批量解密，直接从桶内密文解到各自的明文缓冲区。
+    // 槽位表、明文和批量项都放在栈上的定长数组中
+    int num_live = slot_count(live);
+    int slots[MAX_BUCKET_SLOTS];
+    std::array<vector<char>, MAX_BUCKET_SLOTS> plain;
+    std::array<EnclaveCryptoUtils::Item, MAX_BUCKET_SLOTS> items;
+    size_t num_items = 0;
+    for (int i = 0; live; live &= live - 1, i++) {
+        slots[i] = lowest_slot(live);
+    }
+    for (int i = 0; i < num_live; i++) {
+        const vector<char>& sealed = bkt.blocks[slots[i]].GetData();
+        if (sealed.size() < EnclaveCryptoUtils::kOverhead) {
+            plain[i] = PayloadPool::global().acquire(sealed.size());
+            std::copy(sealed.begin(), sealed.end(), plain[i].begin());
+            continue;
+        }
+        plain[i] = PayloadPool::global().acquire(sealed.size() - EnclaveCryptoUtils::kOverhead);
+        items[num_items++] = {reinterpret_cast<const uint8_t*>(sealed.data()), sealed.size(),
+                              reinterpret_cast<uint8_t*>(plain[i].data())};
+    }
+    if (enclave_crypto->decrypt_batch(items.data(), num_items) != SGX_SUCCESS) {
+        ocall_print_string("[DECRYPT] ERROR: SGX bucket decryption failed");
+        throw std::runtime_error("Bucket decryption failed");
+    }
+
+    for (int i = 0; i < num_live; i++) {
+        const block& encrypted_block = bkt.blocks[slots[i]];
+        stash.insert(block(encrypted_block.GetLeafid(), encrypted_block.GetBlockindex(), std::move(plain[i])));
+    }
+    recycle_bucket(bkt);
 }
 
 void ringoram::WriteBucket(int position) {
+    // 以该桶子树最左侧的叶子作为驱逐路径
     int level = GetlevelFromPos(position);
+    int leaf = (position - ((1 << level) - 1)) << (L - level);
+
+    if (isPositionCached(position)) {
+        tree_top[position] = BuildBucket(leaf, level);
+        return;
+    }
+
+    // 直接使用 SGX 方法写入，写完后密文缓冲区归还载荷池
+    bucket bkt = BuildBucket(leaf, level);
+    sgx_write_bucket(position, bkt);
+    recycle_bucket(bkt);
+}
+
+// 从 stash 中选块组成 leaf 路径上第 level 层的新桶（加密、补齐 dummy、随机排列）
+// 树顶缓存中的桶保持明文
+bucket ringoram::BuildBucket(int leaf, int level) {
+    int position = Path_bucket(leaf, level);
+    bool cached = isPositionCached(position);
 	vector<block> blocksTobucket;
 
-	// 从stash中选择可以放在这个bucket的块
-	for (auto it = stash.begin(); it != stash.end() && blocksTobucket.size() < realBlockEachbkt; ) {
-		int target_leaf = it->GetLeafid();
-		int target_bucket_pos = Path_bucket(target_leaf, level);
-		if (target_bucket_pos == position) {
-			// 对要写回当前bucket的块进行加密
-			if (!it->IsDummy()) {
-				vector<char> plain_data = it->GetData();  // 当前是明文
-				vector<char> encrypted_data = encrypt_data(plain_data);
-
-				// 创建加密后的block
-				block encrypted_block(it->GetLeafid(), it->GetBlockindex(), encrypted_data);
-				blocksTobucket.push_back(encrypted_block);
-			}
-			it = stash.erase(it);
+	// 从stash中取出可以放在这个bucket的块
+	stash.take_for_level(leaf, level, realBlockEachbkt, blocksTobucket);
+
+	// 对要写回当前bucket的块整桶批量加密（树顶缓存中的块保持明文）
+	if (!cached && enclave_crypto && !bucket_sealing && !blocksTobucket.empty()) {
+		vector<vector<char>> sealed(blocksTobucket.size());
+		vector<EnclaveCryptoUtils::Item> items;
+		for (size_t i = 0; i < blocksTobucket.size(); i++) {
+			const vector<char>& plain = blocksTobucket[i].GetData();
+			if (plain.empty()) continue;
+			sealed[i] = PayloadPool::global().acquire(plain.size() + EnclaveCryptoUtils::kOverhead);
+			items.push_back({reinterpret_cast<const uint8_t*>(plain.data()), plain.size(),
+			                 reinterpret_cast<uint8_t*>(sealed[i].data())});
 		}
-		else {
-			++it;
+		if (enclave_crypto->encrypt_batch(items.data(), items.size()) != SGX_SUCCESS) {
+			ocall_print_string("[ENCRYPT] ERROR: SGX bucket encryption failed");
+			throw std::runtime_error("Bucket encryption failed");
+		}
+		// 明文缓冲区换成密文后归还载荷池
+		for (size_t i = 0; i < blocksTobucket.size(); i++) {
+			if (sealed[i].empty()) continue;
+			PayloadPool::global().release(blocksTobucket[i].TakeData());
+			blocksTobucket[i].SetData(std::move(sealed[i]));
 		}
 	}
 
-	// 填充dummy块
-	while (blocksTobucket.size() < realBlockEachbkt + dummyBlockEachbkt) {
-		blocksTobucket.push_back(dummyBlock);
-	}
-
-    // 随机排列
-    for (int i = blocksTobucket.size() - 1; i > 0; --i) {
-        uint32_t j;
-        sgx_read_rand((uint8_t*)&j, sizeof(j));
-        j = j % (i + 1);
-        
-        // 交换元素
-        block temp = blocksTobucket[i];
-        blocksTobucket[i] = blocksTobucket[j];
-        blocksTobucket[j] = temp;
+    // 随机排列槽位下标，真实块按排列移入新桶，其余槽位保持为 dummy
+    vector<int> order(maxblockEachbkt);
+    for (int i = 0; i < maxblockEachbkt; i++) {
+        order[i] = i;
+    }
+    for (int i = maxblockEachbkt - 1; i > 0; --i) {
+        uint32_t j = Drbg::global().uniform(static_cast<uint32_t>(i + 1));
+        std::swap(order[i], order[j]);
     }
 
     // 创建新的bucket
     bucket bktTowrite(realBlockEachbkt, dummyBlockEachbkt);
-    bktTowrite.blocks = blocksTobucket;
+    for (size_t i = 0; i < blocksTobucket.size(); i++) {
+        bktTowrite.blocks[order[i]] = std::move(blocksTobucket[i]);
+    }
 
     for (int i = 0; i < maxblockEachbkt; i++) {
         bktTowrite.ptrs[i] = bktTowrite.blocks[i].GetBlockindex();
-        bktTowrite.valids[i] = 1;
+        bktTowrite.set_valid(i, true);
     }
     bktTowrite.count = 0;
+    bucket_counts[position] = 0;
 
-    // 直接使用 SGX 方法写入
-    sgx_write_bucket(position, bktTowrite);
-    
+    // 整桶密封：所有槽位一起加密，dummy 槽位即载荷密钥流，XOR 读路径同样可以重新生成
+    if (!cached && sealing_enabled()) {
+        seal_bucket(bktTowrite);
+        return bktTowrite;
+    }
+
+    // XOR 读路径：dummy 槽位填入可由 Enclave 重新生成的确定性密文
+    if (xor_read_path && !cached && dummy_payload_size() > 0) {
+        do {
+            bktTowrite.nonce = Drbg::global().next_u64();
+        } while (bktTowrite.nonce == 0);
+
+        for (int i = 0; i < maxblockEachbkt; i++) {
+            if (bktTowrite.ptrs[i] == -1) {
+                bktTowrite.blocks[i].SetData(dummy_payload(position, i, bktTowrite.nonce));
+            }
+        }
+    }
+
+    return bktTowrite;
 }
 
 
+block ringoram::TakeFromTreeTop(int leafid, int blockindex)
+{
+    block cached_block = dummyBlock;
+    int first_level = std::min(cache_levels, L + 1);
+    for (int i = 0; i < first_level; i++) {
+        bucket& bkt = tree_top[Path_bucket(leafid, i)];
+        for (slot_mask_t live = bkt.live_mask(); live; live &= live - 1) {
+            int j = lowest_slot(live);
+            if (bkt.ptrs[j] == blockindex) {
+                cached_block = std::move(bkt.blocks[j]);
+                bkt.set_valid(j, false);
+            }
+        }
+    }
+    return cached_block;
+}
+
+// 返回的目标块已是明文（来自树顶缓存或解密后的 Host 块），未找到时返回 dummyBlock。
+// OCALL 失败或 Host 的应答不合法时抛出 runtime_error：此时位置图已经改过，不能把块当作不存在
 block ringoram::ReadPath(int leafid, int blockindex)
 {
-    uint8_t buffer[65536] = {0};
-    int is_dummy = 0;
-    size_t actual_data_size = 0; 
-   
+    int levels = L + 1;
+    int first_level = std::min(cache_levels, levels);
+
+    // 0. 树顶缓存中的层直接在 Enclave 内查找，不消耗 dummy，也不需要重排
+    block cached_block = TakeFromTreeTop(leafid, blockindex);
+    if (first_level == levels) {
+        return cached_block;
+    }
+
+    if (!path_batch_supported()) {
+        throw std::runtime_error("ReadPath: staging buffer not registered");
+    }
+
+    vector<uint8_t> metadata(levels * MAX_BUCKET_METADATA_SIZE, 0);
+    vector<size_t> meta_sizes(levels, 0);
+
+    // 1. 取回未缓存各层的加密元数据
     sgx_status_t ocall_ret = SGX_SUCCESS;
-    sgx_status_t ret = ocall_read_path(&ocall_ret, leafid, blockindex, &is_dummy, buffer, &actual_data_size);
-   
+    sgx_status_t ret = ocall_read_path_metadata(&ocall_ret, tree_base, leafid, levels, first_level,
+                                                metadata.data(), metadata.size(), meta_sizes.data());
     if (ret != SGX_SUCCESS || ocall_ret != SGX_SUCCESS) {
-        ocall_print_string("ReadPath: OCALL failed");
-        return dummyBlock;
+        throw std::runtime_error("OCALL failure (ocall_read_path_metadata)");
+    }
+
+    // 2. 在 Enclave 内为每层选定偏移（目标块或随机的有效 dummy），更新 valids/count 后重新加密
+    vector<int> offsets(levels, 0);
+    vector<uint64_t> nonces(levels, 0);
+    int found_level = -1;
+    uint64_t found_digest = 0;
+    for (int i = first_level; i < levels; i++) {
+        uint8_t* level_meta = metadata.data() + i * MAX_BUCKET_METADATA_SIZE;
+        bucket meta_bkt(realBlockEachbkt, dummyBlockEachbkt);
+        decrypt_metadata(Path_bucket(leafid, i), level_meta, meta_sizes[i], meta_bkt);
+
+        int offset = GetBlockOffset(meta_bkt, blockindex);
+        if (offset < 0) {
+            throw std::runtime_error("ReadPath: bucket has no valid dummy block");
+        }
+        if (meta_bkt.ptrs[offset] == blockindex) {
+            found_level = i;
+            found_digest = meta_bkt.digests[offset];
+        }
+        meta_bkt.set_valid(offset, false);
+        meta_bkt.count += 1;
+        offsets[i] = offset;
+        nonces[i] = meta_bkt.nonce;
+
+        meta_sizes[i] = encrypt_metadata(Path_bucket(leafid, i), meta_bkt, level_meta);
+    }
+
+    // 3. Host 按偏移每层返回一个块；XOR 模式下只返回所有选中块的异或
+    vector<size_t> block_sizes(levels, 0);
+    size_t xor_size = 0;
+    if (xor_read_path) {
+        ret = ocall_read_path_xor(&ocall_ret, tree_base, leafid, levels, first_level, offsets.data(),
+                                  metadata.data(), metadata.size(), meta_sizes.data(), block_sizes.data(), &xor_size);
+    } else {
+        ret = ocall_read_path_blocks(&ocall_ret, tree_base, leafid, levels, first_level, offsets.data(),
+                                     metadata.data(), metadata.size(), meta_sizes.data(), block_sizes.data());
+    }
+    if (ret != SGX_SUCCESS || ocall_ret != SGX_SUCCESS) {
+        throw std::runtime_error(xor_read_path ? "OCALL failure (ocall_read_path_xor)"
+                                               : "OCALL failure (ocall_read_path_blocks)");
+    }
+
+    // 每层的访问计数都加一，与桶元数据中的 count 保持一致
+    for (int i = first_level; i <= L; i++) {
+        commit_metadata(Path_bucket(leafid, i));
+        uint8_t& cnt = bucket_counts[Path_bucket(leafid, i)];
+        if (cnt < UINT8_MAX) {
+            cnt++;
+        }
+    }
+
+    if (found_level < 0) {
+        return cached_block;
+    }
+
+    if (block_sizes[found_level] > MAX_SERIALIZED_BUCKET_SIZE) {
+        throw std::runtime_error("ReadPath: host reported an oversized block");
+    }
+
+    std::vector<char> encrypted_data;
+    if (xor_read_path) {
+        if (xor_size > MAX_SERIALIZED_BUCKET_SIZE || block_sizes[found_level] > xor_size) {
+            throw std::runtime_error("ReadPath: host reported an oversized XOR response");
+        }
+
+        // 在本地重新生成其余各层的 dummy 密文并异或掉，剩下的就是目标块
+        encrypted_data = PayloadPool::global().acquire(xor_size);
+        memcpy(encrypted_data.data(), staging_buffer, xor_size);
+        for (int i = first_level; i < levels; i++) {
+            if (i == found_level) continue;
+
+            size_t expected = nonces[i] == 0 ? 0 : dummy_payload_size();
+            if (block_sizes[i] != expected) {
+                throw std::runtime_error("ReadPath: dummy block has unexpected size");
+            }
+            vector<char> dummy = dummy_payload(Path_bucket(leafid, i), offsets[i], nonces[i]);
+            for (size_t j = 0; j < dummy.size(); j++) {
+                encrypted_data[j] ^= dummy[j];
+            }
+            PayloadPool::global().release(std::move(dummy));
+        }
+        encrypted_data.resize(block_sizes[found_level]);
+    } else {
+        // 只拷入 Host 声明且已校验的长度，其余层读到的是 dummy，直接丢弃
+        const uint8_t* slot = staging_buffer + found_level * MAX_SERIALIZED_BUCKET_SIZE;
+        encrypted_data = PayloadPool::global().acquire(block_sizes[found_level]);
+        memcpy(encrypted_data.data(), slot, block_sizes[found_level]);
+    }
+    block result(leafid, blockindex, open_slot(encrypted_data, nonces[found_level], offsets[found_level], found_digest));
+    PayloadPool::global().release(std::move(encrypted_data));
+    return result;
+}
+
+// 确定性 dummy 块的长度：与满载的加密块一致（整桶密封时为定长槽位）；未启用加密时 dummy 块没有数据
+size_t ringoram::dummy_payload_size() const {
+    if (!enclave_crypto) return 0;
+    if (bucket_sealing) return sealed_slot_size();
+    return blocksize + SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE;
+}
+
+vector<char> ringoram::dummy_payload(int position, int offset, uint64_t nonce) {
+    if (nonce == 0 || dummy_payload_size() == 0) return {};
+
+    vector<char> payload = PayloadPool::global().acquire(dummy_payload_size());
+    if (bucket_sealing) {
+        // dummy 槽位的明文全零，密文就是该槽位的载荷密钥流
+        size_t slot_size = sealed_slot_size();
+        vector<uint8_t> zeros(slot_size, 0);
+        if (enclave_crypto->payload_keystream(nonce, offset * slot_size, zeros.data(), slot_size,
+                                              reinterpret_cast<uint8_t*>(payload.data())) != SGX_SUCCESS) {
+            throw std::runtime_error("Dummy block generation failed");
+        }
+        return payload;
+    }
+    sgx_status_t ret = enclave_crypto->dummy_ciphertext(tree_base + position, offset, nonce,
+                                                        reinterpret_cast<uint8_t*>(payload.data()), payload.size());
+    if (ret != SGX_SUCCESS) {
+        throw std::runtime_error("Dummy block generation failed");
     }
+    return payload;
+}
 
+int ringoram::eviction_leaf(int g) const {
+    unsigned int v = static_cast<unsigned int>(g) & ((1u << L) - 1);
+    unsigned int leaf = 0;
+    for (int i = 0; i < L; i++) {
+        leaf = (leaf << 1) | (v & 1u);
+        v >>= 1;
+    }
+    return static_cast<int>(leaf);
+}
 
-    if (is_dummy) {
-        return dummyBlock;
+void ringoram::prefetch_eviction_paths(int count) {
+    int first_level = std::min(cache_levels, L + 1);
+    if (!evictionPrefetch || first_level > L) {
+        return;
     }
- 
-    std::vector<char> encrypted_data(buffer, buffer + actual_data_size);
-    return block(leafid, blockindex, encrypted_data);
+    vector<int> leaves(count);
+    for (int i = 0; i < count; i++) {
+        leaves[i] = eviction_leaf(G + count + i);
+    }
+    ocall_prefetch_paths(tree_base, L + 1, first_level, leaves.data(), count);
 }
 
 void ringoram::EvictPath() {
-    int l = G % (1 << L);
+    int l = eviction_leaf(G);
     G += 1;
 
+    if (!path_batch_supported()) {
+        for (int i = 0; i <= L; i++) {
+            ReadBucket(Path_bucket(l, i));
+        }
+
+        for (int i = L; i >= 0; i--) {
+            WriteBucket(Path_bucket(l, i));
+        }
+        return;
+    }
+
+    // 未缓存的层整条路径一次读入、一次写回，缓存的层在 Enclave 内处理
+    int first_level = std::min(cache_levels, L + 1);
+    vector<uint8_t> wanted(L + 1, 0);
+    vector<bool> dirty(L + 1, false);
+    for (int i = first_level; i <= L; i++) {
+        wanted[i] = 1;
+        dirty[i] = true;
+    }
+
+    vector<bucket> path;
+    if (first_level <= L) {
+        sgx_read_path_buckets(l, path, wanted);
+    }
     for (int i = 0; i <= L; i++) {
-        ReadBucket(Path_bucket(l, i));
+        if (i < first_level) {
+            ReadBucket(Path_bucket(l, i));
+        } else {
+            AbsorbBucket(path[i]);
+        }
     }
 
     for (int i = L; i >= 0; i--) {
-        WriteBucket(Path_bucket(l, i));
+        if (i < first_level) {
+            tree_top[Path_bucket(l, i)] = BuildBucket(l, i);
+        } else {
+            path[i] = BuildBucket(l, i);
+        }
+    }
+    if (first_level <= L) {
+        sgx_write_path_buckets(l, path, dirty);
+        for (int i = first_level; i <= L; i++) {
+            recycle_bucket(path[i]);
+        }
+    }
+}
+
+void ringoram::EvictPaths(int count) {
+    // 下一批驱逐要在 count * EvictRound 次访问之后才发生，Host 有足够的时间预取
+    prefetch_eviction_paths(std::max(count, 1));
+
+    if (count <= 1) {
+        EvictPath();
+        return;
+    }
+
+    vector<int> leaves;
+    for (int i = 0; i < count; i++) {
+        leaves.push_back(eviction_leaf(G + i));
+    }
+
+    // 各路径桶的并集（去重），level_leaves[d] 为第 d 层每个不同的桶选一条经过它的路径
+    int first_level = std::min(cache_levels, L + 1);
+    vector<vector<int>> level_leaves(L + 1);
+    vector<int> positions;
+    std::unordered_map<int, int> slot_of;
+    for (int d = 0; d <= L; d++) {
+        for (int leaf : leaves) {
+            int pos = Path_bucket(leaf, d);
+            if (slot_of.count(pos)) continue;
+            slot_of.emplace(pos, d < first_level ? -1 : static_cast<int>(positions.size()));
+            level_leaves[d].push_back(leaf);
+            if (d >= first_level) {
+                positions.push_back(pos);
+            }
+        }
+    }
+
+    // 暂存区放不下并集时逐条驱逐
+    if (!path_batch_supported() || positions.size() > staging_size / MAX_SERIALIZED_BUCKET_SIZE) {
+        for (int i = 0; i < count; i++) {
+            EvictPath();
+        }
+        return;
+    }
+    G += count;
+
+    vector<bucket> buckets;
+    if (!positions.empty()) {
+        sgx_read_buckets(positions, buckets);
+    }
+    for (int d = 0; d <= L; d++) {
+        for (int leaf : level_leaves[d]) {
+            int pos = Path_bucket(leaf, d);
+            if (d < first_level) {
+                ReadBucket(pos);
+            } else {
+                AbsorbBucket(buckets[slot_of[pos]]);
+            }
+        }
+    }
+
+    // 自底向上逐层放置：整棵子树较深的桶先从 stash 取块，每个桶只重建一次
+    for (int d = L; d >= 0; d--) {
+        for (int leaf : level_leaves[d]) {
+            int pos = Path_bucket(leaf, d);
+            if (d < first_level) {
+                tree_top[pos] = BuildBucket(leaf, d);
+            } else {
+                buckets[slot_of[pos]] = BuildBucket(leaf, d);
+            }
+        }
+    }
+    if (!positions.empty()) {
+        sgx_write_buckets(positions, buckets);
+        for (auto& bkt : buckets) {
+            recycle_bucket(bkt);
+        }
     }
 }
 
 void ringoram::EarlyReshuffle(int l) {
+    // 根据 Enclave 内的访问计数找出需要重排的桶，只取回这些桶
+    vector<uint8_t> wanted(L + 1, 0);
+    bool any_wanted = false;
     for (int i = 0; i <= L; i++) {
-        int position = Path_bucket(l, i);
-        bucket bkt = sgx_read_bucket(position);
-        
-        if (bkt.count >= dummyBlockEachbkt) {
+        if (bucket_counts[Path_bucket(l, i)] >= dummyBlockEachbkt) {
+            wanted[i] = 1;
+            any_wanted = true;
+        }
+    }
+    if (!any_wanted) {
+        return;
+    }
 
-            for (int j = 0; j < maxblockEachbkt; j++) {
-		        // 只读取真实且有效的块
-		        if (bkt.ptrs[j] != -1 && bkt.valids[j] && !bkt.blocks[j].IsDummy()) {
-			        // 读取时解密
-			        block encrypted_block = bkt.blocks[j];
-			        vector<char> decrypted_data = decrypt_data(encrypted_block.GetData());
-			        block decrypted_block(encrypted_block.GetLeafid(), encrypted_block.GetBlockindex(), decrypted_data);
-			        stash.push_back(decrypted_block);
-		        }
-	        }
+    if (!path_batch_supported()) {
+        for (int i = 0; i <= L; i++) {
+            if (wanted[i]) {
+                ReadBucket(Path_bucket(l, i));
+                WriteBucket(Path_bucket(l, i));
+            }
+        }
+        return;
+    }
+
+    vector<bucket> path;
+    sgx_read_path_buckets(l, path, wanted);
 
-            WriteBucket(position);
+    vector<bool> dirty(L + 1, false);
+    for (int i = 0; i <= L; i++) {
+        if (wanted[i]) {
+            AbsorbBucket(path[i]);
+            path[i] = BuildBucket(l, i);
+            dirty[i] = true;
+        }
+    }
+    sgx_write_path_buckets(l, path, dirty);
+    for (int i = 0; i <= L; i++) {
+        if (dirty[i]) {
+            recycle_bucket(path[i]);
         }
     }
 }
 
+// 直接在 vector<char> 的缓冲区上加解密，不再经 vector<uint8_t> 中转
 std::vector<char> ringoram::encrypt_data(const std::vector<char>& data) {
     if (!enclave_crypto || data.empty()) return data;
 
-    vector<uint8_t> data_u8(data.begin(), data.end());
-    vector<uint8_t> encrypted_u8;
-    
-    sgx_status_t ret = enclave_crypto->encrypt(data_u8, encrypted_u8);
+    vector<char> encrypted = PayloadPool::global().acquire(data.size() + EnclaveCryptoUtils::kOverhead);
+    sgx_status_t ret = enclave_crypto->encrypt_to(reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+                                                  reinterpret_cast<uint8_t*>(encrypted.data()));
     if (ret != SGX_SUCCESS) {
         ocall_print_string("[ENCRYPT] ERROR: SGX encryption failed");
         return data;
     }
     
-    return vector<char>(encrypted_u8.begin(), encrypted_u8.end());
+    return encrypted;
 }
 
 std::vector<char> ringoram::decrypt_data(const std::vector<char>& encrypted_data) {
     if (!enclave_crypto || encrypted_data.empty()) return encrypted_data;
+    if (encrypted_data.size() < EnclaveCryptoUtils::kOverhead) {
+        ocall_print_string("[DECRYPT] ERROR: SGX decryption failed");
+        return encrypted_data;
+    }
 
-    if (encrypted_data.size() % 16 != 0) {
-        char error_msg[100];
-        snprintf(error_msg, sizeof(error_msg), 
-                "[DECRYPT] ERROR: Size %zu not multiple of 16", encrypted_data.size());
-        ocall_print_string(error_msg);
+    vector<char> decrypted = PayloadPool::global().acquire(encrypted_data.size() - EnclaveCryptoUtils::kOverhead);
+    sgx_status_t ret = enclave_crypto->decrypt_to(reinterpret_cast<const uint8_t*>(encrypted_data.data()),
+                                                  encrypted_data.size(), reinterpret_cast<uint8_t*>(decrypted.data()));
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("[DECRYPT] ERROR: SGX decryption failed");
         return encrypted_data;
     }
+    
+    return decrypted;
+}
 
-    try {
-        vector<uint8_t> encrypted_u8(encrypted_data.begin(), encrypted_data.end());
-        vector<uint8_t> decrypted_u8;
-        
-        sgx_status_t ret = enclave_crypto->decrypt(encrypted_u8, decrypted_u8);
-        if (ret != SGX_SUCCESS) {
-            ocall_print_string("[DECRYPT] ERROR: SGX decryption failed");
-            return encrypted_data;
+
+size_t ringoram::sealed_slot_size() const {
+    return (sizeof(uint32_t) + blocksize + 15) / 16 * 16;
+}
+
+// 槽位明文的摘要：SHA-256 的前 8 字节，随加密元数据保存，Host 无法改写
+uint64_t ringoram::slot_digest(const uint8_t* slot_plain) {
+    sgx_sha256_hash_t hash;
+    if (sgx_sha256_msg(slot_plain, static_cast<uint32_t>(sealed_slot_size()), &hash) != SGX_SUCCESS) {
+        throw std::runtime_error("Slot digest failed");
+    }
+    uint64_t digest;
+    memcpy(&digest, hash, sizeof(digest));
+    return digest;
+}
+
+void ringoram::seal_bucket(bucket& bkt) {
+    size_t slot_size = sealed_slot_size();
+    int num_slots = maxblockEachbkt;
+    vector<uint8_t> plain(slot_size * num_slots, 0);
+    for (int i = 0; i < num_slots; i++) {
+        bkt.digests[i] = 0;
+        if (bkt.ptrs[i] == -1) {
+            continue;
         }
-        
-        return vector<char>(decrypted_u8.begin(), decrypted_u8.end());
-    } catch (...) {
-        ocall_print_string("[DECRYPT] ERROR: Exception during decryption");
-        return encrypted_data;
+
+        const vector<char>& data = bkt.blocks[i].GetData();
+        if (data.size() > slot_size - sizeof(uint32_t)) {
+            throw std::runtime_error("Block larger than a sealed slot");
+        }
+        uint8_t* slot = plain.data() + i * slot_size;
+        uint32_t length = static_cast<uint32_t>(data.size());
+        memcpy(slot, &length, sizeof(length));
+        memcpy(slot + sizeof(length), data.data(), data.size());
+        bkt.digests[i] = slot_digest(slot);
+    }
+
+    bkt.nonce = enclave_crypto->next_nonce();
+    vector<uint8_t> sealed(plain.size());
+    if (enclave_crypto->seal_payload(bkt.nonce, plain.data(), plain.size(), sealed.data(),
+                                     reinterpret_cast<sgx_aes_gcm_128bit_tag_t*>(bkt.tag)) != SGX_SUCCESS) {
+        ocall_print_string("[ENCRYPT] ERROR: SGX bucket sealing failed");
+        throw std::runtime_error("Bucket encryption failed");
+    }
+
+    // 各槽位的明文缓冲区换成密文槽位，均经由载荷池
+    PayloadPool& pool = PayloadPool::global();
+    for (int i = 0; i < num_slots; i++) {
+        vector<char> data = pool.acquire(slot_size);
+        memcpy(data.data(), sealed.data() + i * slot_size, slot_size);
+        pool.release(bkt.blocks[i].TakeData());
+        bkt.blocks[i].SetData(std::move(data));
     }
 }
 
+vector<char> ringoram::open_slot(const vector<char>& ciphertext, uint64_t nonce, int offset, uint64_t digest) {
+    if (!sealing_enabled()) {
+        return decrypt_data(ciphertext);
+    }
+
+    size_t slot_size = sealed_slot_size();
+    if (ciphertext.size() != slot_size || nonce == 0) {
+        throw std::runtime_error("Sealed slot has unexpected size");
+    }
+    vector<uint8_t> plain(slot_size);
+    if (enclave_crypto->payload_keystream(nonce, offset * slot_size, reinterpret_cast<const uint8_t*>(ciphertext.data()),
+                                          slot_size, plain.data()) != SGX_SUCCESS) {
+        throw std::runtime_error("Sealed slot decryption failed");
+    }
+    if (slot_digest(plain.data()) != digest) {
+        ocall_print_string("[DECRYPT] ERROR: sealed slot failed its digest check");
+        throw std::runtime_error("Sealed slot failed authentication");
+    }
+
+    uint32_t length;
+    memcpy(&length, plain.data(), sizeof(length));
+    if (length > slot_size - sizeof(length)) {
+        throw std::runtime_error("Sealed slot has an invalid length");
+    }
+    vector<char> data = PayloadPool::global().acquire(length);
+    memcpy(data.data(), plain.data() + sizeof(length), length);
+    return data;
+}
 
 vector<char> ringoram::access(int blockindex, Operation op, vector<char> data)
+{
+	return update(blockindex, [&](vector<char>& blockdata) {
+		// WRITE 操作替换数据，READ 保持不变；容量够时直接拷进块原有的（载荷池）缓冲区
+		if (op == WRITE) {
+			blockdata.assign(data.begin(), data.end());
+		}
+	});
+}
+
+vector<char> ringoram::update(int blockindex, const std::function<void(vector<char>&)>& fn)
 {
 	if (blockindex < 0 || blockindex >= N) {
 
 		return {};
 	}
 
-	int oldLeaf = positionmap[blockindex];
-	positionmap[blockindex] = get_random();
+	// 前台访问优先：登记等待，后台线程在当前任务结束后让出锁
+	ForegroundLock lock;
+	untouched = false;
 
-	// 1. 读取路径获取目标块（加密状态）
+	int newLeaf = 0;
+	vector<PositionMap::Relocation> relocations;
+	int oldLeaf = take_pending_leaf(blockindex, posmap->remap(blockindex, newLeaf, relocations));
+	queue_relocations(relocations);
+
+	// 后台模式下该路径的重排可能还在队列里，先保证路径上每个桶都还有可用的 dummy
+	if (eviction_deferred()) {
+		EarlyReshuffle(oldLeaf);
+	}
+
+	// 1. 读取路径获取目标块（ReadPath 已解密）
 	block interestblock = ReadPath(oldLeaf, blockindex);
 	vector<char> blockdata;
    
 	// 2. 处理读取到的块
 	if (interestblock.GetBlockindex() == blockindex) {
-		// 从路径读取到的目标块，需要解密
-		if (!interestblock.IsDummy()) {
-			blockdata = decrypt_data(interestblock.GetData());
+		blockdata = interestblock.TakeData();
+	}
+	else {
+		// 3. 如果不在路径中，检查stash（按块号索引）
+		block stashed;
+		if (stash.take(blockindex, stashed)) {
+			blockdata = stashed.TakeData();   // stash中已经是明文
+		}
+	}
+
+	// 4. 在 Enclave 内更新数据
+	fn(blockdata);
+
+	// 明文（载荷池缓冲区）放入stash，返回给调用方的是唯一的一份拷贝
+	vector<char> result = blockdata;
+	stash.insert(block(newLeaf, blockindex, std::move(blockdata)));
+
+	// 5. 路径管理和驱逐
+	finish_access(oldLeaf);
+
+	// 6. 固定节奏的搬移槽（压缩位置图的组计数器溢出后换了叶子的块）
+	if (relocation_due()) {
+		relocation_slot();
+	}
+
+	return result;
+}
+
+vector<vector<char>> ringoram::accessBatch(const vector<Request>& requests)
+{
+	vector<int> blockindices;
+	blockindices.reserve(requests.size());
+	for (const auto& req : requests) {
+		blockindices.push_back(req.blockindex);
+	}
+
+	return update_batch(blockindices, [&requests](size_t i, vector<char>& blockdata) {
+		if (requests[i].op == WRITE) {
+			blockdata = requests[i].data;
+		}
+	});
+}
+
+// 已完成位置图更新、等待读取的一个批量请求
+struct BatchEntry {
+	size_t request;
+	int blockindex;
+	int old_leaf;
+	int new_leaf;
+};
+
+vector<vector<char>> ringoram::update_batch(const vector<int>& blockindices,
+                                            const std::function<void(size_t, vector<char>&)>& fn,
+                                            size_t dummies)
+{
+	ForegroundLock lock;
+	untouched = false;
+
+	vector<vector<char>> results(blockindices.size());
+	int levels = L + 1;
+	int first_level = std::min(cache_levels, levels);
+	// 暂存区按满载加密块估计能容纳的块数，放不下时 Host 拒绝，整批退回逐条读取
+	size_t max_reads = staging_buffer
+		? staging_size / (static_cast<size_t>(blocksize) + SGX_AESGCM_IV_SIZE + SGX_AESGCM_MAC_SIZE) : 0;
+
+	vector<BatchEntry> pending;
+	std::unordered_map<int, int> uses;     // 未缓存桶 -> 本批中读它的次数
+	size_t pending_reads = 0;
+	int due_slots = 0;                     // 本批中到期的搬移槽数
+
+	// 执行当前攒下的一批：取元数据、选偏移、读块，然后逐个完成访问
+	auto flush = [&]() {
+		if (pending.empty()) return;
+
+		vector<block> found(pending.size(), dummyBlock);
+		// 整批读取：返回 false 表示暂存区放不下、Host 未做任何修改，需要逐条路径读取。
+		// OCALL 失败时与 ReadPath 相同抛出 runtime_error（定序器把它交给批内所有等待的请求）
+		auto read_batched = [&]() -> bool {
+			// 1. 路径并集上的未缓存桶（去重）
+			vector<int> positions;
+			std::unordered_map<int, int> bucket_slot;
+			for (const auto& e : pending) {
+				for (int i = first_level; i < levels; i++) {
+					int pos = Path_bucket(e.old_leaf, i);
+					if (bucket_slot.emplace(pos, static_cast<int>(positions.size())).second) {
+						positions.push_back(pos);
+					}
+				}
+			}
+
+			int num_buckets = static_cast<int>(positions.size());
+			vector<uint8_t> metadata(num_buckets * MAX_BUCKET_METADATA_SIZE, 0);
+			vector<size_t> meta_sizes(num_buckets, 0);
+			sgx_status_t ocall_ret = SGX_SUCCESS;
+			sgx_status_t ret = ocall_read_buckets_metadata(&ocall_ret, tree_base, num_buckets, positions.data(),
+			                                               metadata.data(), metadata.size(), meta_sizes.data());
+			if (ret != SGX_SUCCESS || ocall_ret != SGX_SUCCESS) {
+				throw std::runtime_error("OCALL failure (ocall_read_buckets_metadata)");
+			}
+
+			vector<bucket> metas(num_buckets, bucket(realBlockEachbkt, dummyBlockEachbkt));
+			for (int b = 0; b < num_buckets; b++) {
+				decrypt_metadata(positions[b], metadata.data() + b * MAX_BUCKET_METADATA_SIZE, meta_sizes[b], metas[b]);
+			}
+
+			// 2. 每个请求在自己路径的每层读一个槽位：目标块或随机的有效 dummy
+			vector<int> read_buckets, read_offsets;
+			vector<int> found_read(pending.size(), -1);
+			vector<uint64_t> found_digest(pending.size(), 0);
+			for (size_t r = 0; r < pending.size(); r++) {
+				for (int i = first_level; i < levels; i++) {
+					int b = bucket_slot[Path_bucket(pending[r].old_leaf, i)];
+					int offset = GetBlockOffset(metas[b], pending[r].blockindex);
+					if (offset < 0) {
+						throw std::runtime_error("accessBatch: bucket has no valid dummy block");
+					}
+					if (metas[b].ptrs[offset] == pending[r].blockindex) {
+						found_read[r] = static_cast<int>(read_buckets.size());
+						found_digest[r] = metas[b].digests[offset];
+					}
+					metas[b].set_valid(offset, false);
+					metas[b].count += 1;
+					read_buckets.push_back(b);
+					read_offsets.push_back(offset);
+				}
+			}
+			for (int b = 0; b < num_buckets; b++) {
+				meta_sizes[b] = encrypt_metadata(positions[b], metas[b], metadata.data() + b * MAX_BUCKET_METADATA_SIZE);
+			}
+
+			// 3. 写回元数据并一次读回所有块
+			int num_reads = static_cast<int>(read_buckets.size());
+			vector<size_t> block_sizes(num_reads, 0);
+			ret = ocall_read_blocks(&ocall_ret, tree_base, num_buckets, positions.data(),
+			                        metadata.data(), metadata.size(), meta_sizes.data(),
+			                        num_reads, read_buckets.data(), read_offsets.data(), block_sizes.data());
+			if (ret == SGX_SUCCESS && ocall_ret == SGX_ERROR_OUT_OF_MEMORY) {
+				return false;
+			}
+			if (ret != SGX_SUCCESS || ocall_ret != SGX_SUCCESS) {
+				throw std::runtime_error("OCALL failure (ocall_read_blocks)");
+			}
+
+			for (int b = 0; b < num_buckets; b++) {
+				commit_metadata(positions[b]);
+				uint8_t& cnt = bucket_counts[positions[b]];
+				int reads = uses[positions[b]];
+				cnt = static_cast<uint8_t>(std::min<int>(UINT8_MAX, cnt + reads));
+			}
+
+			// 块在暂存区中紧密排列，先算出每个块的起点
+			vector<size_t> starts(num_reads + 1, 0);
+			for (int j = 0; j < num_reads; j++) {
+				starts[j + 1] = starts[j] + block_sizes[j];
+			}
+			if (starts[num_reads] > staging_size) {
+				throw std::runtime_error("accessBatch: host reported oversized blocks");
+			}
+
+			for (size_t r = 0; r < pending.size(); r++) {
+				block cached = TakeFromTreeTop(pending[r].old_leaf, pending[r].blockindex);
+				if (found_read[r] >= 0) {
+					const uint8_t* data = staging_buffer + starts[found_read[r]];
+					vector<char> encrypted = PayloadPool::global().acquire(block_sizes[found_read[r]]);
+					memcpy(encrypted.data(), data, block_sizes[found_read[r]]);
+					int j = found_read[r];
+					found[r] = block(pending[r].old_leaf, pending[r].blockindex,
+					                 open_slot(encrypted, metas[read_buckets[j]].nonce, read_offsets[j], found_digest[r]));
+					PayloadPool::global().release(std::move(encrypted));
+				} else {
+					found[r] = cached;
+				}
+			}
+			return true;
+		};
+
+		// XOR 读路径只有单路径的 OCALL，启用时逐条路径读取
+		bool batched = !xor_read_path && path_batch_supported() && first_level < levels && pending_reads > 0;
+		if (batched) {
+			batched = read_batched();
+		}
+
+		// 未缓存层为空、启用了 XOR 读路径或暂存区放不下：逐条路径读取
+		if (!batched) {
+			for (size_t r = 0; r < pending.size(); r++) {
+				found[r] = ReadPath(pending[r].old_leaf, pending[r].blockindex);
+			}
 		}
-		else {
-			blockdata = interestblock.GetData();
+
+		// 4. 按请求顺序完成访问（同一块的后续请求从 stash 中取到前一个请求的结果）
+		for (size_t r = 0; r < pending.size(); r++) {
+			const BatchEntry& e = pending[r];
+			if (e.blockindex == N) {
+				continue;   // 伪访问只读路径
+			}
+			vector<char> blockdata;
+			block stashed;
+			if (found[r].GetBlockindex() == e.blockindex) {
+				blockdata = found[r].TakeData();
+			} else if (stash.take(e.blockindex, stashed)) {
+				blockdata = stashed.TakeData();
+			}
+
+			fn(e.request, blockdata);
+			results[e.request] = blockdata;
+			stash.insert(block(e.new_leaf, e.blockindex, std::move(blockdata)));
 		}
+
+		// 5. 整批读完之后统一驱逐与重排
+		for (const auto& e : pending) {
+			finish_access(e.old_leaf);
+		}
+
+		pending.clear();
+		uses.clear();
+		pending_reads = 0;
+	};
+
+	// 当前批中再加入 leaf 的路径后，每个桶被读的次数不能超过它剩余的 dummy 数
+	auto fits = [&](int leaf) {
+		if (pending_reads + (levels - first_level) > max_reads && !pending.empty()) {
+			return false;
+		}
+		for (int i = first_level; i < levels; i++) {
+			int pos = Path_bucket(leaf, i);
+			auto it = uses.find(pos);
+			int used = it == uses.end() ? 0 : it->second;
+			if (used + 1 > dummyBlockEachbkt - bucket_counts[pos]) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	for (size_t idx = 0; idx < blockindices.size() + dummies; idx++) {
+		BatchEntry entry{idx, N, 0, 0};
+		if (idx < blockindices.size()) {
+			entry.blockindex = blockindices[idx];
+			if (entry.blockindex < 0 || entry.blockindex >= N) {
+				continue;
+			}
+			vector<PositionMap::Relocation> relocations;
+			entry.old_leaf = take_pending_leaf(entry.blockindex,
+			                                   posmap->remap(entry.blockindex, entry.new_leaf, relocations));
+			queue_relocations(relocations);
+		} else {
+			// 伪访问：块号 N 不存在，随机路径上每层读一个有效 dummy
+			entry.old_leaf = get_random();
+			entry.new_leaf = entry.old_leaf;
+		}
+		if (relocation_due()) {
+			due_slots++;
+		}
+
+		if (!fits(entry.old_leaf)) {
+			flush();
+			// 空批也放不下说明该路径上有桶等待重排（后台模式下重排还在队列里）
+			if (!fits(entry.old_leaf)) {
+				EarlyReshuffle(entry.old_leaf);
+			}
+		}
+
+		pending.push_back(entry);
+		pending_reads += levels - first_level;
+		for (int i = first_level; i < levels; i++) {
+			uses[Path_bucket(entry.old_leaf, i)]++;
+		}
+
 	}
-	else {
-		// 3. 如果不在路径中，检查stash
-		for (auto it = stash.begin(); it != stash.end(); ++it) {
-			if (it->GetBlockindex() == blockindex) {
-				blockdata = it->GetData();   // stash中已经是明文
-				stash.erase(it);
-				break;
+	flush();
+
+	// 本批应有的搬移槽在整批读完之后统一执行
+	for (int i = 0; i < due_slots; i++) {
+		relocation_slot();
+	}
+
+	return results;
+}
+
+void ringoram::dummy_access()
+{
+	ForegroundLock lock;
+	untouched = false;
+
+	read_random_path();
+
+	// 伪访问与真实访问一样计入搬移节奏
+	if (relocation_due()) {
+		relocation_slot();
+	}
+}
+
+void ringoram::read_random_path()
+{
+	int leaf = get_random();
+	if (eviction_deferred()) {
+		EarlyReshuffle(leaf);
+	}
+
+	// 块号 N 不存在，每层都读一个随机的有效 dummy
+	ReadPath(leaf, N);
+	finish_access(leaf);
+}
+
+bool ringoram::can_bulk_load() const
+{
+	return untouched && stash.empty();
+}
+
+void ringoram::bulk_load(vector<pair<int, vector<char>>>& blocks)
+{
+	std::lock_guard<std::recursive_mutex> lock(storage_mutex);
+	if (!can_bulk_load()) {
+		throw std::runtime_error("Bulk load needs an ORAM that has not been accessed");
+	}
+	untouched = false;
+
+	vector<int> indices;
+	indices.reserve(blocks.size());
+	vector<bool> seen(N, false);
+	for (const auto& b : blocks) {
+		if (b.first < 0 || b.first >= N || seen[b.first]) {
+			throw std::runtime_error("Bulk load got an invalid or repeated block index");
+		}
+		seen[b.first] = true;
+		indices.push_back(b.first);
+	}
+
+	// 1. 位置图为每块分配初始叶子（递归位置图把叶子打包后同样批量装入内层树）
+	vector<int> leaves;
+	posmap->bulk_assign(indices, leaves);
+
+	vector<size_t> order(blocks.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&leaves](size_t a, size_t b) { return leaves[a] < leaves[b]; });
+
+	// 2. 写出的桶攒满暂存区再一次写回；树顶缓存的桶直接放在 Enclave 内
+	size_t batch = staging_buffer ? staging_size / MAX_SERIALIZED_BUCKET_SIZE : 0;
+	vector<int> positions;
+	vector<bucket> pending;
+	int written = 0;
+	auto flush = [&]() {
+		if (positions.empty()) return;
+		if (batch > 1) {
+			sgx_write_buckets(positions, pending);
+		} else {
+			for (size_t i = 0; i < positions.size(); i++) {
+				sgx_write_bucket(positions[i], pending[i]);
 			}
 		}
+		for (auto& bkt : pending) {
+			recycle_bucket(bkt);
+		}
+		positions.clear();
+		pending.clear();
+	};
+	auto place = [&](int leaf, int level) {
+		int pos = Path_bucket(leaf, level);
+		if (isPositionCached(pos)) {
+			tree_top[pos] = BuildBucket(leaf, level);
+			return;
+		}
+		bucket bkt = BuildBucket(leaf, level);
+		if (bulkLoadSkipEmpty && bkt.live_mask() == 0) {
+			// 没有真实块的桶不写出，Host 上保持未写过的空桶
+			recycle_bucket(bkt);
+			return;
+		}
+		positions.push_back(pos);
+		pending.push_back(std::move(bkt));
+		written++;
+		if (positions.size() >= std::max<size_t>(batch, 1)) {
+			flush();
+		}
+	};
+
+	// 3. 按叶子顺序后序遍历：叶子桶先取该叶子的块，某棵子树的最后一个叶子处理完后再写它的祖先桶，
+	//    stash 中只留下子树内放不下、等待更高层的块。空桶同样写出，Host 看不出哪些桶装了真实块；
+	//    bulkLoadSkipEmpty 时跳过空桶（初始叶子与数据无关，空桶的位置只反映随机选取的叶子）
+	size_t next = 0;
+	for (int leaf = 0; leaf < num_leaves; leaf++) {
+		while (next < order.size() && leaves[order[next]] == leaf) {
+			auto& b = blocks[order[next]];
+			stash.insert(block(leaf, b.first, std::move(b.second)));
+			next++;
+		}
+		place(leaf, L);
+		for (int level = L - 1; level >= 0; level--) {
+			if ((leaf + 1) % (1 << (L - level)) != 0) break;
+			place(leaf, level);
+		}
 	}
+	flush();
 
-	// 4. 如果是WRITE操作，更新数据
-	if (op == WRITE) {
-		blockdata = data;
+	char msg[128];
+	snprintf(msg, sizeof(msg), "Bulk loaded %zu blocks into %d buckets (%d written), %zu left in the stash",
+	         blocks.size(), num_bucket, written, stash.size());
+	ocall_print_string(msg);
+}
+
+// 与一次普通访问相同：读旧路径、计入驱逐轮次、检查重排，只是数据不变
+void ringoram::relocate(const PositionMap::Relocation& r)
+{
+	if (eviction_deferred()) {
+		EarlyReshuffle(r.old_leaf);
+	}
+
+	block found = ReadPath(r.old_leaf, r.blockindex);
+	block stashed;
+	if (found.GetBlockindex() == r.blockindex) {
+		stash.insert(block(r.new_leaf, r.blockindex, found.TakeData()));
+	}
+	else if (stash.take(r.blockindex, stashed)) {
+		stash.insert(block(r.new_leaf, r.blockindex, stashed.TakeData()));
 	}
 
-	// 明文放入stash
-	stash.emplace_back(positionmap[blockindex], blockindex, blockdata);
+	finish_access(r.old_leaf);
+}
 
-	// 5. 路径管理和驱逐
-	round = (round + 1) % EvictRound;
-	if (round == 0) EvictPath();
+void ringoram::queue_relocations(const vector<PositionMap::Relocation>& relocations)
+{
+	for (const auto& r : relocations) {
+		auto it = pending_relocations.find(r.blockindex);
+		if (it == pending_relocations.end()) {
+			pending_relocations.emplace(r.blockindex, r);
+		} else {
+			it->second.new_leaf = r.new_leaf;
+		}
+	}
+}
+
+int ringoram::take_pending_leaf(int blockindex, int leaf)
+{
+	auto it = pending_relocations.find(blockindex);
+	if (it == pending_relocations.end()) {
+		return leaf;
+	}
+	int old_leaf = it->second.old_leaf;
+	pending_relocations.erase(it);
+	return old_leaf;
+}
+
+bool ringoram::relocation_due()
+{
+	int interval = posmap->relocation_interval();
+	if (interval <= 0) {
+		return false;
+	}
+	relocation_round = (relocation_round + 1) % interval;
+	return relocation_round == 0;
+}
+
+void ringoram::relocation_slot()
+{
+	if (pending_relocations.empty()) {
+		read_random_path();
+		return;
+	}
+	auto it = pending_relocations.begin();
+	PositionMap::Relocation r = it->second;
+	pending_relocations.erase(it);
+	relocate(r);
+}
+
+bool ringoram::eviction_deferred() const
+{
+	return background_eviction && eviction_worker_running;
+}
+
+void ringoram::finish_access(int leaf)
+{
+	// 每 eviction_paths * EvictRound 次访问一起驱逐 eviction_paths 条路径，平均频率与逐条驱逐相同
+	round = (round + 1) % (EvictRound * eviction_paths);
+	bool deferred = eviction_deferred();
+	if (round == 0) {
+		if (deferred) schedule_eviction(true, 0);
+		else EvictPaths(eviction_paths);
+	}
 
-	EarlyReshuffle(oldLeaf);
+	if (deferred) schedule_eviction(false, leaf);
+	else EarlyReshuffle(leaf);
+}
+
+// 调用方持有 storage_mutex
+void ringoram::schedule_eviction(bool evict_path, int leaf)
+{
+	eviction_queue.push_back({this, evict_path, leaf});
+
+	// 队列超出上限时在前台执行最早的任务，stash 的增长因此有界
+	while (eviction_queue.size() > static_cast<size_t>(std::max(evictionBacklog, 0))) {
+		EvictionTask task = eviction_queue.front();
+		eviction_queue.pop_front();
+		run_eviction_task(task);
+	}
+	eviction_cv.notify_one();
+}
+
+// ================================
+// 后台驱逐线程
+// ================================
+
+void ringoram::run_eviction_task(const EvictionTask& task)
+{
+	if (task.evict_path) {
+		task.oram->EvictPaths(task.oram->eviction_paths);
+	} else {
+		task.oram->EarlyReshuffle(task.leaf);
+	}
+}
+
+void ringoram::eviction_worker()
+{
+	std::unique_lock<std::recursive_mutex> lock(storage_mutex);
+	eviction_worker_running = true;
+
+	while (true) {
+		eviction_cv.wait(lock, [] {
+			return eviction_stop || (!eviction_queue.empty() && foreground_waiting.load() == 0);
+		});
+		if (eviction_stop) break;
+
+		EvictionTask task = eviction_queue.front();
+		eviction_queue.pop_front();
+		try {
+			run_eviction_task(task);
+		} catch (const std::exception& e) {
+			char msg[200];
+			snprintf(msg, sizeof(msg), "Background eviction failed: %s", e.what());
+			ocall_print_string(msg);
+		}
+	}
 
-	return blockdata;
+	// 退出前把剩余任务做完，之后的访问回到就地驱逐；清除停止标志，之后可以重新启动后台线程
+	eviction_worker_running = false;
+	eviction_stop = false;
+	while (!eviction_queue.empty()) {
+		EvictionTask task = eviction_queue.front();
+		eviction_queue.pop_front();
+		run_eviction_task(task);
+	}
+}
+
+void ringoram::stop_eviction_worker()
+{
+	std::lock_guard<std::recursive_mutex> lock(storage_mutex);
+	eviction_stop = true;
+	eviction_cv.notify_all();
+}
+
+void ringoram::flush_evictions()
+{
+	std::lock_guard<std::recursive_mutex> lock(storage_mutex);
+	while (!eviction_queue.empty()) {
+		EvictionTask task = eviction_queue.front();
+		eviction_queue.pop_front();
+		run_eviction_task(task);
+	}
 }
 
 
@@ -321,7 +1468,7 @@ size_t ringoram::calculate_bucket_size(const bucket& bkt) const{
     }
     
     // 添加ptrs和valids的大小
-    size_t ptrs_valids_size = (bkt.ptrs.size() + bkt.valids.size()) * sizeof(int32_t);
+    size_t ptrs_valids_size = 2 * bkt.slots() * sizeof(int32_t);
     size += ptrs_valids_size;
     
     return size;
@@ -343,58 +1490,83 @@ void ringoram::serialize_block(const block& blk, uint8_t* buffer, size_t& offset
     }
 }
 
-block ringoram::deserialize_block(const uint8_t* data, size_t& offset) {
+block ringoram::deserialize_block(const uint8_t* data, size_t size, size_t& offset) {
+    if (offset > size || size - offset < sizeof(SerializedBlockHeader)) {
+        throw std::runtime_error("Malformed bucket from host: truncated block header");
+    }
     const SerializedBlockHeader* header = reinterpret_cast<const SerializedBlockHeader*>(data + offset);
     offset += sizeof(SerializedBlockHeader);
+    if (header->data_size < 0 || static_cast<size_t>(header->data_size) > size - offset) {
+        throw std::runtime_error("Malformed bucket from host: block data exceeds bucket");
+    }
     
     std::vector<char> block_data;
     if (header->data_size > 0) {
-        block_data.resize(header->data_size);
+        block_data = PayloadPool::global().acquire(header->data_size);
         memcpy(block_data.data(), data + offset, header->data_size);
         offset += header->data_size;
     }
     
-    return block(header->leaf_id, header->block_index, block_data);
+    return block(header->leaf_id, header->block_index, std::move(block_data));
 }
 
 std::vector<uint8_t> ringoram::serialize_bucket(const bucket& bkt) {
+    std::vector<uint8_t> result(calculate_bucket_size(bkt));
+    serialize_bucket_to(bkt, result.data(), result.size());
+    return result;
+}
+
+// 直接序列化到调用方提供的缓冲区（例如暂存区），返回写入的字节数，空间不足时返回 0
+size_t ringoram::serialize_bucket_to(const bucket& bkt, uint8_t* out, size_t max_size) const {
     size_t total_size = calculate_bucket_size(bkt);
-    std::vector<uint8_t> result(total_size);
+    if (total_size > max_size) {
+        return 0;
+    }
     
-    SerializedBucketHeader* bucket_header = reinterpret_cast<SerializedBucketHeader*>(result.data());
+    // count、ptrs、valids 以及块的 leaf/index 只保存在加密元数据中，
+    // 明文线格式里写占位值，Host 只能看到每个槽位的数据长度
+    SerializedBucketHeader* bucket_header = reinterpret_cast<SerializedBucketHeader*>(out);
     bucket_header->Z = bkt.Z;
     bucket_header->S = bkt.S;
-    bucket_header->count = bkt.count;
+    bucket_header->count = 0;
     bucket_header->num_blocks = static_cast<int32_t>(bkt.blocks.size());
     
     size_t offset = sizeof(SerializedBucketHeader);
     
     for (const auto& blk : bkt.blocks) {
-        serialize_block(blk, result.data(), offset);
+        SerializedBlockHeader* block_header = reinterpret_cast<SerializedBlockHeader*>(out + offset);
+        serialize_block(blk, out, offset);
+        block_header->leaf_id = -1;
+        block_header->block_index = -1;
     }
     
-    if (offset + (bkt.ptrs.size() + bkt.valids.size()) * sizeof(int32_t) <= total_size) {
-        for (int ptr : bkt.ptrs) {
-            *reinterpret_cast<int32_t*>(result.data() + offset) = ptr;
+    if (offset + 2 * bkt.slots() * sizeof(int32_t) <= total_size) {
+        for (int i = 0; i < bkt.slots(); i++) {
+            *reinterpret_cast<int32_t*>(out + offset) = -1;
             offset += sizeof(int32_t);
         }
         
-        for (int valid : bkt.valids) {
-            *reinterpret_cast<int32_t*>(result.data() + offset) = valid;
+        for (int i = 0; i < bkt.slots(); i++) {
+            *reinterpret_cast<int32_t*>(out + offset) = 0;
             offset += sizeof(int32_t);
         }
     }
     
-    return result;
+    return total_size;
 }
 
 bucket ringoram::deserialize_bucket(const uint8_t* data, size_t size) {
     if (size < sizeof(SerializedBucketHeader)) {
-        ocall_print_string("Invalid bucket data: too small");
-        return bucket(realBlockEachbkt, dummyBlockEachbkt);
+        throw std::runtime_error("Malformed bucket from host: too small");
     }
     
     const SerializedBucketHeader* bucket_header = reinterpret_cast<const SerializedBucketHeader*>(data);
+
+    // 桶的形状由两侧一致的参数决定，Host 给出的 Z、S 和块数只用来校验
+    if (bucket_header->Z != realBlockEachbkt || bucket_header->S != dummyBlockEachbkt ||
+        bucket_header->num_blocks < 0 || bucket_header->num_blocks > maxblockEachbkt) {
+        throw std::runtime_error("Malformed bucket from host: unexpected bucket shape");
+    }
     
     // 创建bucket但不预先分配blocks
     bucket result(0, 0);  // 先创建空的
@@ -408,31 +1580,172 @@ bucket ringoram::deserialize_bucket(const uint8_t* data, size_t size) {
     size_t offset = sizeof(SerializedBucketHeader);
     
     // 反序列化 blocks
-    for (int i = 0; i < bucket_header->num_blocks && offset < size; i++) {
-        result.blocks.push_back(deserialize_block(data, offset));
+    for (int i = 0; i < bucket_header->num_blocks; i++) {
+        result.blocks.push_back(deserialize_block(data, size, offset));
     }
     
-    // 重新初始化ptrs和valids
+    // result 由 bucket(0, 0) 构造：ptrs 全为 -1、没有有效槽位
     int num_slots = result.Z + result.S;
-    result.ptrs.resize(num_slots, -1);
-    result.valids.resize(num_slots, 0);
     
     // 反序列化 ptrs 和 valids
-    if (offset + num_slots * 2 * sizeof(int32_t) <= size) {
+    if (size - offset < num_slots * 2 * sizeof(int32_t)) {
+        throw std::runtime_error("Malformed bucket from host: truncated slot table");
+    }
+    for (int i = 0; i < num_slots; i++) {
+        int32_t ptr = *reinterpret_cast<const int32_t*>(data + offset);
+        result.ptrs[i] = ptr;
+        offset += sizeof(int32_t);
+    }
+    
+    for (int i = 0; i < num_slots; i++) {
+        int32_t valid = *reinterpret_cast<const int32_t*>(data + offset);
+        result.set_valid(i, valid != 0);
+        offset += sizeof(int32_t);
+    }
+    
+    return result;
+}
+
+// ================================
+// 桶元数据（count、ptrs、valids）的加解密
+// ================================
+
+// 明文格式：int32 count、uint64 nonce，随后是 Z+S 个 int32 ptr、Z+S 个 int32 valid 和 Z+S 个 int32 leaf
+// 叶子随桶保存，读回桶时不必查询位置图（递归/压缩位置图的查询代价很高）。
+// 整桶密封时 nonce 之后多出 16 字节的载荷标签，末尾多出 Z+S 个 uint64 槽位摘要
+static const int kMetadataFixedFields = 3;
+static const int kMetadataSlotFields = 3;
+static const int kSealedFixedFields = 4;
+static const int kSealedSlotFields = 2;
+
+static int metadata_fixed_fields(bool sealed) {
+    return kMetadataFixedFields + (sealed ? kSealedFixedFields : 0);
+}
+
+static int metadata_slot_fields(bool sealed) {
+    return kMetadataSlotFields + (sealed ? kSealedSlotFields : 0);
+}
+
+// 元数据的 AAD：桶在 Host 存储中的全局桶号 | 写回次数
+struct MetadataAad {
+    uint32_t position;
+    uint32_t version;
+};
+
+// 明文在栈上拼好后直接加密到 out（至少 MAX_BUCKET_METADATA_SIZE 字节），不经过堆
+size_t ringoram::encrypt_metadata(int position, const bucket& bkt, uint8_t* out) {
+    int num_slots = realBlockEachbkt + dummyBlockEachbkt;
+    int fixed = metadata_fixed_fields(bucket_sealing);
+    size_t plain_size = (fixed + metadata_slot_fields(bucket_sealing) * num_slots) * sizeof(int32_t);
+    size_t sealed_size = enclave_crypto ? plain_size + EnclaveCryptoUtils::kOverhead : plain_size;
+    if (sealed_size > MAX_BUCKET_METADATA_SIZE) {
+        throw std::runtime_error("Bucket metadata encryption failed");
+    }
+
+    int32_t fields[MAX_BUCKET_METADATA_SIZE / sizeof(int32_t)];
+    fields[0] = bkt.count;
+    memcpy(fields + 1, &bkt.nonce, sizeof(bkt.nonce));
+    for (int i = 0; i < num_slots; i++) {
+        fields[fixed + i] = bkt.ptrs[i];
+        fields[fixed + num_slots + i] = bkt.is_valid(i) ? 1 : 0;
+        fields[fixed + 2 * num_slots + i] =
+            i < static_cast<int>(bkt.blocks.size()) ? bkt.blocks[i].GetLeafid() : -1;
+    }
+    if (bucket_sealing) {
+        memcpy(fields + kMetadataFixedFields, bkt.tag, sizeof(bkt.tag));
         for (int i = 0; i < num_slots; i++) {
-            int32_t ptr = *reinterpret_cast<const int32_t*>(data + offset);
-            result.ptrs[i] = ptr;
-            offset += sizeof(int32_t);
+            memcpy(fields + fixed + 3 * num_slots + 2 * i, &bkt.digests[i], sizeof(uint64_t));
         }
-        
+    }
+
+    const uint8_t* plain = reinterpret_cast<const uint8_t*>(fields);
+    if (!enclave_crypto) {
+        memcpy(out, plain, plain_size);
+        return plain_size;
+    }
+
+    MetadataAad aad = { static_cast<uint32_t>(tree_base + position), bucket_versions[position] + 1 };
+    if (enclave_crypto->encrypt_to(plain, plain_size, out, reinterpret_cast<const uint8_t*>(&aad), sizeof(aad)) != SGX_SUCCESS) {
+        throw std::runtime_error("Bucket metadata encryption failed");
+    }
+    return sealed_size;
+}
+
+// Host 确认写入后调用：之后该桶的元数据按新的写回次数认证
+void ringoram::commit_metadata(int position) {
+    bucket_versions[position]++;
+}
+
+// 解密元数据并填入 bkt 的 count/ptrs/valids 及各槽位块的叶子；
+// size 为 0 只在 Enclave 从未写过该桶时视为全 dummy 的空桶，否则说明 Host 丢弃了元数据
+void ringoram::decrypt_metadata(int position, const uint8_t* data, size_t size, bucket& bkt) {
+    int num_slots = realBlockEachbkt + dummyBlockEachbkt;
+    int fixed = metadata_fixed_fields(bucket_sealing);
+    bkt.ptrs.fill(-1);
+    bkt.valid = full_slot_mask(num_slots);
+    bkt.digests.fill(0);
+    memset(bkt.tag, 0, sizeof(bkt.tag));
+    bkt.count = 0;
+    bkt.nonce = 0;
+    if (size == 0) {
+        if (bucket_versions[position] != 0) {
+            throw std::runtime_error("Bucket metadata missing for a written bucket");
+        }
+        for (auto& blk : bkt.blocks) {
+            blk.SetLeafid(-1);
+        }
+        return;
+    }
+
+    // 解密到栈上的定长缓冲区
+    size_t plain_size = (fixed + metadata_slot_fields(bucket_sealing) * num_slots) * sizeof(int32_t);
+    size_t expected = enclave_crypto ? plain_size + EnclaveCryptoUtils::kOverhead : plain_size;
+    if (size != expected || size > MAX_BUCKET_METADATA_SIZE) {
+        throw std::runtime_error("Bucket metadata has unexpected size");
+    }
+    int32_t fields[MAX_BUCKET_METADATA_SIZE / sizeof(int32_t)];
+    if (!enclave_crypto) {
+        memcpy(fields, data, size);
+    } else {
+        MetadataAad aad = { static_cast<uint32_t>(tree_base + position), bucket_versions[position] };
+        if (enclave_crypto->decrypt_to(data, size, reinterpret_cast<uint8_t*>(fields),
+                                       reinterpret_cast<const uint8_t*>(&aad), sizeof(aad)) != SGX_SUCCESS) {
+            throw std::runtime_error("Bucket metadata decryption failed");
+        }
+    }
+
+    bkt.count = fields[0];
+    memcpy(&bkt.nonce, fields + 1, sizeof(bkt.nonce));
+    for (int i = 0; i < num_slots; i++) {
+        bkt.ptrs[i] = fields[fixed + i];
+        bkt.set_valid(i, fields[fixed + num_slots + i] != 0);
+        if (i < static_cast<int>(bkt.blocks.size())) {
+            bkt.blocks[i].SetLeafid(fields[fixed + 2 * num_slots + i]);
+        }
+    }
+    if (bucket_sealing) {
+        memcpy(bkt.tag, fields + kMetadataFixedFields, sizeof(bkt.tag));
         for (int i = 0; i < num_slots; i++) {
-            int32_t valid = *reinterpret_cast<const int32_t*>(data + offset);
-            result.valids[i] = valid;
-            offset += sizeof(int32_t);
+            memcpy(&bkt.digests[i], fields + fixed + 3 * num_slots + 2 * i, sizeof(uint64_t));
         }
     }
-    
-    return result;
+}
+
+// 用元数据恢复从线格式读回的桶：ptrs 给出块号，叶子随元数据一起保存
+void ringoram::apply_metadata(int position, bucket& bkt, const uint8_t* data, size_t size) {
+    decrypt_metadata(position, data, size, bkt);
+
+    for (size_t i = 0; i < bkt.blocks.size() && i < static_cast<size_t>(bkt.slots()); i++) {
+        int index = bkt.ptrs[i];
+        if (index < 0 || index >= N) {
+            // 不是本树的块号：按 dummy 槽位处理
+            bkt.ptrs[i] = -1;
+            bkt.blocks[i].SetBlockindex(-1);
+            bkt.blocks[i].SetLeafid(-1);
+            continue;
+        }
+        bkt.blocks[i].SetBlockindex(index);
+    }
 }
 
 // ================================
@@ -440,13 +1753,16 @@ bucket ringoram::deserialize_bucket(const uint8_t* data, size_t size) {
 // ================================
 
 bucket ringoram::sgx_read_bucket(int position) {
-    
-    const size_t BUFFER_SIZE = 65536;
-    uint8_t buffer[BUFFER_SIZE];
+    if (!staging_buffer) {
+        throw std::runtime_error("Staging buffer not registered");
+    }
 
     // ocall 的封装函数第一个参数是用于接收 host 实现返回值的 sgx_status_t*
+    size_t actual_size = 0;
+    uint8_t metadata[MAX_BUCKET_METADATA_SIZE];
+    size_t meta_size = 0;
     sgx_status_t ocall_ret = SGX_SUCCESS;
-    sgx_status_t ret = ocall_read_bucket(&ocall_ret, position, buffer);
+    sgx_status_t ret = ocall_read_bucket(&ocall_ret, tree_base + position, &actual_size, metadata, sizeof(metadata), &meta_size);
 
     if (ret != SGX_SUCCESS) {
         ocall_print_string("SGX: ocall_read_bucket failed at runtime level");
@@ -456,31 +1772,37 @@ bucket ringoram::sgx_read_bucket(int position) {
         ocall_print_string("SGX: ocall_read_bucket reported host-level failure");
         throw std::runtime_error("OCALL host-level failure (ocall_read_bucket)");
     }
+    if (actual_size > staging_size) {
+        ocall_print_string("SGX: ocall_read_bucket reported an oversized bucket");
+        throw std::runtime_error("Bucket larger than staging buffer");
+    }
 
-    return deserialize_bucket(buffer, BUFFER_SIZE);
+    // 先把声明的长度拷入 Enclave，再解析，避免 Host 在解析期间篡改
+    std::vector<uint8_t> local(staging_buffer, staging_buffer + actual_size);
+    bucket bkt = deserialize_bucket(local.data(), local.size());
+    apply_metadata(position, bkt, metadata, meta_size);
+    return bkt;
 }
 
 void ringoram::sgx_write_bucket(int position, const bucket& bkt) {
-    const size_t BUFFER_SIZE = 65536;
-
-    // 序列化
-    auto serialized = serialize_bucket(bkt);
-    if (serialized.empty()) {
-        ocall_print_string("SGX: serialize_bucket returned empty");
-        throw std::runtime_error("Bucket serialization failed");
+    if (!staging_buffer) {
+        throw std::runtime_error("Staging buffer not registered");
     }
 
-    
-    if (serialized.size() > BUFFER_SIZE) {
+    // 直接序列化到暂存区
+    size_t written = serialize_bucket_to(bkt, staging_buffer, MAX_SERIALIZED_BUCKET_SIZE);
+    if (written == 0) {
         char errbuf[200];
-        snprintf(errbuf, sizeof(errbuf), "SGX: serialized bucket too large: %zu > %zu", serialized.size(), BUFFER_SIZE);
+        snprintf(errbuf, sizeof(errbuf), "SGX: serialized bucket too large: %zu > %zu", calculate_bucket_size(bkt), MAX_SERIALIZED_BUCKET_SIZE);
         ocall_print_string(errbuf);
         throw std::runtime_error("Serialized bucket larger than allowed buffer ");
     }
 
     // 调用 ocall（第一个参数为接收 host 返回值的指针）
+    uint8_t metadata[MAX_BUCKET_METADATA_SIZE];
+    size_t meta_size = encrypt_metadata(position, bkt, metadata);
     sgx_status_t ocall_ret = SGX_SUCCESS;
-    sgx_status_t ret = ocall_write_bucket(&ocall_ret, position, serialized.data());
+    sgx_status_t ret = ocall_write_bucket(&ocall_ret, tree_base + position, written, metadata, meta_size);
 
     if (ret != SGX_SUCCESS) {
         ocall_print_string("SGX: ocall_write_bucket failed at runtime level");
@@ -490,4 +1812,177 @@ void ringoram::sgx_write_bucket(int position, const bucket& bkt) {
         ocall_print_string("SGX: ocall_write_bucket reported host-level failure");
         throw std::runtime_error("OCALL host-level failure (ocall_write_bucket)");
     }
-}
\ No newline at end of file
+    commit_metadata(position);
+}
+
+// 暂存区能否容纳整条路径（L + 1 个桶槽）
+bool ringoram::path_batch_supported() const {
+    return staging_buffer && staging_size / MAX_SERIALIZED_BUCKET_SIZE >= static_cast<size_t>(L + 1);
+}
+
+void ringoram::sgx_read_path_buckets(int leaf, vector<bucket>& path, const vector<uint8_t>& wanted) {
+    if (!path_batch_supported()) {
+        throw std::runtime_error("Staging buffer cannot hold a whole path");
+    }
+
+    int levels = L + 1;
+    vector<size_t> actual_sizes(levels, 0);
+    vector<uint8_t> metadata(levels * MAX_BUCKET_METADATA_SIZE, 0);
+    vector<size_t> meta_sizes(levels, 0);
+    sgx_status_t ocall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ocall_read_path_buckets(&ocall_ret, tree_base, leaf, levels, wanted.data(), actual_sizes.data(),
+                                               metadata.data(), metadata.size(), meta_sizes.data());
+
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_read_path_buckets failed at runtime level");
+        throw std::runtime_error("OCALL runtime failure (ocall_read_path_buckets)");
+    }
+    if (ocall_ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_read_path_buckets reported host-level failure");
+        throw std::runtime_error("OCALL host-level failure (ocall_read_path_buckets)");
+    }
+
+    path.clear();
+    path.reserve(levels);
+    std::vector<uint8_t> local;
+    for (int i = 0; i < levels; i++) {
+        if (!wanted[i]) {
+            path.push_back(bucket(realBlockEachbkt, dummyBlockEachbkt));
+            continue;
+        }
+        if (actual_sizes[i] > MAX_SERIALIZED_BUCKET_SIZE) {
+            ocall_print_string("SGX: ocall_read_path_buckets reported an oversized bucket");
+            throw std::runtime_error("Bucket larger than staging slot");
+        }
+
+        // 与 sgx_read_bucket 相同：先拷入 Enclave 再解析
+        const uint8_t* slot = staging_buffer + i * MAX_SERIALIZED_BUCKET_SIZE;
+        local.assign(slot, slot + actual_sizes[i]);
+        path.push_back(deserialize_bucket(local.data(), local.size()));
+        apply_metadata(Path_bucket(leaf, i), path.back(), metadata.data() + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+    }
+}
+
+void ringoram::sgx_write_path_buckets(int leaf, const vector<bucket>& path, const vector<bool>& dirty) {
+    if (!path_batch_supported()) {
+        throw std::runtime_error("Staging buffer cannot hold a whole path");
+    }
+
+    int levels = L + 1;
+    vector<size_t> data_sizes(levels, 0);
+    vector<uint8_t> metadata(levels * MAX_BUCKET_METADATA_SIZE, 0);
+    vector<size_t> meta_sizes(levels, 0);
+    for (int i = 0; i < levels; i++) {
+        if (!dirty[i]) {
+            continue;
+        }
+
+        meta_sizes[i] = encrypt_metadata(Path_bucket(leaf, i), path[i], metadata.data() + i * MAX_BUCKET_METADATA_SIZE);
+
+        // 每层直接序列化到暂存区中对应的槽
+        uint8_t* slot = staging_buffer + i * MAX_SERIALIZED_BUCKET_SIZE;
+        data_sizes[i] = serialize_bucket_to(path[i], slot, MAX_SERIALIZED_BUCKET_SIZE);
+        if (data_sizes[i] == 0) {
+            char errbuf[200];
+            snprintf(errbuf, sizeof(errbuf), "SGX: serialized bucket too large: %zu > %zu", calculate_bucket_size(path[i]), MAX_SERIALIZED_BUCKET_SIZE);
+            ocall_print_string(errbuf);
+            throw std::runtime_error("Serialized bucket larger than allowed buffer ");
+        }
+    }
+
+    sgx_status_t ocall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ocall_write_path_buckets(&ocall_ret, tree_base, leaf, levels, data_sizes.data(),
+                                                metadata.data(), metadata.size(), meta_sizes.data());
+
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_write_path_buckets failed at runtime level");
+        throw std::runtime_error("OCALL runtime failure (ocall_write_path_buckets)");
+    }
+    if (ocall_ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_write_path_buckets reported host-level failure");
+        throw std::runtime_error("OCALL host-level failure (ocall_write_path_buckets)");
+    }
+    for (int i = 0; i < levels; i++) {
+        if (dirty[i]) {
+            commit_metadata(Path_bucket(leaf, i));
+        }
+    }
+}
+
+void ringoram::sgx_read_buckets(const vector<int>& positions, vector<bucket>& buckets) {
+    int num_buckets = static_cast<int>(positions.size());
+    if (!staging_buffer || positions.size() > staging_size / MAX_SERIALIZED_BUCKET_SIZE) {
+        throw std::runtime_error("Staging buffer cannot hold the requested buckets");
+    }
+
+    vector<size_t> actual_sizes(num_buckets, 0);
+    vector<uint8_t> metadata(num_buckets * MAX_BUCKET_METADATA_SIZE, 0);
+    vector<size_t> meta_sizes(num_buckets, 0);
+    sgx_status_t ocall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ocall_read_buckets(&ocall_ret, tree_base, num_buckets, positions.data(), actual_sizes.data(),
+                                          metadata.data(), metadata.size(), meta_sizes.data());
+
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_read_buckets failed at runtime level");
+        throw std::runtime_error("OCALL runtime failure (ocall_read_buckets)");
+    }
+    if (ocall_ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_read_buckets reported host-level failure");
+        throw std::runtime_error("OCALL host-level failure (ocall_read_buckets)");
+    }
+
+    buckets.clear();
+    buckets.reserve(num_buckets);
+    std::vector<uint8_t> local;
+    for (int i = 0; i < num_buckets; i++) {
+        if (actual_sizes[i] > MAX_SERIALIZED_BUCKET_SIZE) {
+            ocall_print_string("SGX: ocall_read_buckets reported an oversized bucket");
+            throw std::runtime_error("Bucket larger than staging slot");
+        }
+
+        // 与 sgx_read_bucket 相同：先拷入 Enclave 再解析
+        const uint8_t* slot = staging_buffer + i * MAX_SERIALIZED_BUCKET_SIZE;
+        local.assign(slot, slot + actual_sizes[i]);
+        buckets.push_back(deserialize_bucket(local.data(), local.size()));
+        apply_metadata(positions[i], buckets.back(), metadata.data() + i * MAX_BUCKET_METADATA_SIZE, meta_sizes[i]);
+    }
+}
+
+void ringoram::sgx_write_buckets(const vector<int>& positions, const vector<bucket>& buckets) {
+    int num_buckets = static_cast<int>(positions.size());
+    if (!staging_buffer || positions.size() > staging_size / MAX_SERIALIZED_BUCKET_SIZE) {
+        throw std::runtime_error("Staging buffer cannot hold the requested buckets");
+    }
+
+    vector<size_t> data_sizes(num_buckets, 0);
+    vector<uint8_t> metadata(num_buckets * MAX_BUCKET_METADATA_SIZE, 0);
+    vector<size_t> meta_sizes(num_buckets, 0);
+    for (int i = 0; i < num_buckets; i++) {
+        meta_sizes[i] = encrypt_metadata(positions[i], buckets[i], metadata.data() + i * MAX_BUCKET_METADATA_SIZE);
+
+        uint8_t* slot = staging_buffer + i * MAX_SERIALIZED_BUCKET_SIZE;
+        data_sizes[i] = serialize_bucket_to(buckets[i], slot, MAX_SERIALIZED_BUCKET_SIZE);
+        if (data_sizes[i] == 0) {
+            char errbuf[200];
+            snprintf(errbuf, sizeof(errbuf), "SGX: serialized bucket too large: %zu > %zu", calculate_bucket_size(buckets[i]), MAX_SERIALIZED_BUCKET_SIZE);
+            ocall_print_string(errbuf);
+            throw std::runtime_error("Serialized bucket larger than allowed buffer ");
+        }
+    }
+
+    sgx_status_t ocall_ret = SGX_SUCCESS;
+    sgx_status_t ret = ocall_write_buckets(&ocall_ret, tree_base, num_buckets, positions.data(), data_sizes.data(),
+                                           metadata.data(), metadata.size(), meta_sizes.data());
+
+    if (ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_write_buckets failed at runtime level");
+        throw std::runtime_error("OCALL runtime failure (ocall_write_buckets)");
+    }
+    if (ocall_ret != SGX_SUCCESS) {
+        ocall_print_string("SGX: ocall_write_buckets reported host-level failure");
+        throw std::runtime_error("OCALL host-level failure (ocall_write_buckets)");
+    }
+    for (int i = 0; i < num_buckets; i++) {
+        commit_metadata(positions[i]);
+    }
+}
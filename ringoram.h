@@ -3,38 +3,66 @@
 #include "bucket.h"
 #include "CryptoUtil.h"
 #include "param.h"
+#include "stash.h"
+#include "posmap.h"
 #include <vector>
 #include <cmath>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
 
 
 using namespace std;
 
-// 序列化结构定义
-#pragma pack(push, 1)
-struct SerializedBucketHeader {
-    int32_t Z;
-    int32_t S;
-    int32_t count;
-    int32_t num_blocks;
-};
-
-struct SerializedBlockHeader {
-    int32_t leaf_id;
-    int32_t block_index;
-    int32_t data_size;
-    // 变长数据跟在后面
-};
-#pragma pack(pop)
-
 class ringoram
 {
 public:
-    static int round;
-    static int G;
+    // 驱逐轮次与驱逐路径计数（每个实例独立，递归位置图的内层 ORAM 有自己的驱逐节奏）
+    int round;
+    int G;
+
+    // Host 注册的不可信暂存区（所有 ringoram 实例共享）
+    static uint8_t* staging_buffer;
+    static size_t staging_size;
+    static sgx_status_t set_staging_buffer(uint8_t* buffer, size_t size);
+
+    // 后台驱逐：Host 线程经 ecall_oram_eviction_worker 进入 Enclave 后运行 eviction_worker，
+    // 依次执行各实例排队的 EvictPath/EarlyReshuffle。所有 ringoram 共享暂存区和 Host 存储，
+    // 因此桶读写都在同一把全局的 storage_mutex 下进行；有前台访问等待时后台线程让出。
+    // 这只是把驱逐推迟到前台访问之间执行（前台不必等驱逐完成才返回），驱逐与访问并不会同时进行，
+    // 不是流水线：两者的桶读写仍然串行
+    struct EvictionTask {
+        ringoram* oram;
+        bool evict_path;   // true 为 EvictPath，false 为对 leaf 路径的 EarlyReshuffle
+        int leaf;
+    };
+    static std::recursive_mutex storage_mutex;
+    static std::condition_variable_any eviction_cv;
+    static std::deque<EvictionTask> eviction_queue;
+    static std::atomic<int> foreground_waiting;
+    static bool eviction_worker_running;
+    static bool eviction_stop;
+    static void eviction_worker();
+    static void stop_eviction_worker();
+    // 在调用线程上执行完所有排队的任务（例如 Host 重置存储之前）
+    static void flush_evictions();
+    static void run_eviction_task(const EvictionTask& task);
     
-    int* positionmap;
-    vector<block> stash;
+    std::unique_ptr<PositionMap> posmap;
+    Stash stash;
+    // 每个桶的访问计数（Enclave 内维护，ReadPath 递增，重写桶时清零）
+    vector<uint8_t> bucket_counts;
+    // 每个桶的元数据写回 Host 的次数（Enclave 内维护），与桶号一起作为元数据的 AAD；
+    // 为 0 表示 Enclave 从未写过该桶，只有这时才接受 Host 返回的空元数据
+    vector<uint32_t> bucket_versions;
+    // 树顶缓存：前 cache_levels 层的桶（按位置索引），以明文保存在 Enclave 内
+    vector<bucket> tree_top;
+    // 树顶缓存从所有实例共享的堆预算中预留的字节数
+    size_t tree_top_reserved;
     int c;
     
     
@@ -45,11 +73,34 @@ public:
     int num_bucket;
     int num_leaves;
     int cache_levels;
+    bool xor_read_path;
+    // 本树在 Host 存储中的起始桶号（递归位置图的内层树放在外层树之后）
+    int tree_base;
+    // 是否把本实例的驱逐/重排交给后台线程（后台线程未运行时仍就地执行）
+    bool background_eviction;
+    // 每次驱逐一起处理的连续路径数（evictionPaths）
+    int eviction_paths;
+    // 整桶密封模式（bucketSealing），设置了加密工具时生效
+    bool bucket_sealing;
+    // 构造后尚未有过任何访问（此时可以批量装载）
+    bool untouched;
+    // 位置图换了叶子、尚未搬到新路径的块（块号 -> 搬移），按固定节奏逐个搬移；
+    // 搬移前块仍在 old_leaf 路径或 stash 中，访问它时从 old_leaf 读取
+    std::unordered_map<int, PositionMap::Relocation> pending_relocations;
+    int relocation_round;
 
     enum Operation { READ, WRITE };
+
+    // accessBatch 的一个请求
+    struct Request {
+        int blockindex;
+        Operation op;
+        vector<char> data;
+    };
     
     
-    ringoram(int n, int cache_levels = cacheLevel);
+    ringoram(int n, int cache_levels = cacheLevel, int posmap_mode = posMapMode, int tree_base = 0);
+    ~ringoram();
 
     bool isPositionCached(int position) const {
         return position < (1 << cache_levels) - 1;
@@ -59,26 +110,101 @@ public:
     int get_random();
     int Path_bucket(int leaf, int level);
     int GetlevelFromPos(int pos);
-    block FindBlock(bucket bkt, int offset) const;
-    int GetBlockOffset(bucket bkt, int blockindex) const;
+    const block& FindBlock(const bucket& bkt, int offset) const;
+    int GetBlockOffset(const bucket& bkt, int blockindex) const;
     void ReadBucket(int pos);
+    // 取出桶中的块后桶内的密文缓冲区归还载荷池，桶随后应被重建或丢弃
+    void AbsorbBucket(bucket& bkt);
+    // 把桶内所有块的数据缓冲区归还载荷池（桶写回 Host 之后）
+    void recycle_bucket(bucket& bkt);
     void WriteBucket(int position);
+    bucket BuildBucket(int leaf, int level);
+    size_t dummy_payload_size() const;
+    vector<char> dummy_payload(int position, int offset, uint64_t nonce);
+    // 在树顶缓存的层中查找并取出块（置为无效），未找到时返回 dummyBlock
+    block TakeFromTreeTop(int leafid, int blockindex);
     block ReadPath(int leafid, int blockindex);
+    // 第 g 次驱逐的叶子：反向字典序，即 g 的低 L 位按位反转，相邻的驱逐路径只在树顶附近重合
+    int eviction_leaf(int g) const;
     void EvictPath();
+    // 一次驱逐 count 条连续的驱逐路径：桶并集只读写一次，count 为 1 时等同 EvictPath
+    void EvictPaths(int count);
+    // 把第 G + count 次起的 count 条驱逐路径告知 Host 预取
+    void prefetch_eviction_paths(int count);
     void EarlyReshuffle(int l);
     std::vector<char> encrypt_data(const std::vector<char>& data);
     std::vector<char> decrypt_data(const std::vector<char>& encrypted_data);
+
+    // 整桶密封：每个槽位的明文为 uint32 长度 | 数据 | 0 填充，按 16 字节对齐
+    bool sealing_enabled() const { return bucket_sealing && enclave_crypto != nullptr; }
+    size_t sealed_slot_size() const;
+    uint64_t slot_digest(const uint8_t* slot_plain);
+    // 把桶的所有槽位（含 dummy）作为一个 GCM 消息加密，设置 nonce、标签和各槽位摘要
+    void seal_bucket(bucket& bkt);
+    // 单槽读取得到的密文解为块数据：整桶密封时用载荷密钥流解密并以摘要校验，否则按逐块 GCM 解密
+    vector<char> open_slot(const vector<char>& ciphertext, uint64_t nonce, int offset, uint64_t digest);
     vector<char> access(int blockindex, Operation op, vector<char> data);
+    // 一次访问内完成读-改-写：fn 在 Enclave 内原地修改块的明文（块不存在时为空），返回修改后的数据
+    vector<char> update(int blockindex, const std::function<void(vector<char>&)>& fn);
+    // 批量访问：多个请求路径的并集上，每个未缓存的桶只取回并更新一次元数据，所有块一次 OCALL 读回，
+    // 驱逐与重排在整批读完之后统一进行（启用 XOR 读路径时逐条路径读取）。结果按请求顺序返回，语义与依次调用 access 相同
+    vector<vector<char>> accessBatch(const vector<Request>& requests);
+    // accessBatch 的核心：fn(i, data) 在第 i 个请求的访问内原地修改块数据。
+    // dummies 个伪访问（随机路径）与真实请求一起走同样的批量读取，Host 无法区分
+    vector<vector<char>> update_batch(const vector<int>& blockindices,
+                                      const std::function<void(size_t, vector<char>&)>& fn,
+                                      size_t dummies = 0);
+    // 批量装载：构造后尚未访问时一次放入一组块（块号各不相同，数据被移走）。位置图为每块分配初始叶子，
+    // 按叶子顺序后序遍历整棵树，每个桶从 stash 取能放下的最深的块后直接写出；每个桶只写一次、不读路径，
+    // 放不下的块留在 stash
+    bool can_bulk_load() const;
+    void bulk_load(vector<pair<int, vector<char>>>& blocks);
+    // 伪访问：读一条随机路径并计入驱逐轮次，Host 看到的与一次真实访问相同
+    void dummy_access();
+    // 位置图改变了某块的叶子时，把它从旧路径读出，以新叶子放回 stash
+    void relocate(const PositionMap::Relocation& r);
+    // 把位置图给出的搬移并入待搬移表（已在表中的块保留最初的 old_leaf）
+    void queue_relocations(const vector<PositionMap::Relocation>& relocations);
+    // 访问的块若还在待搬移表中，返回它实际所在的旧叶子并移出表，否则返回 leaf
+    int take_pending_leaf(int blockindex, int leaf);
+    // 每次访问（含伪访问）计数一次，每 posmap->relocation_interval() 次返回 true
+    bool relocation_due();
+    // 搬移槽：有待搬移的块时搬一个，否则读一条随机路径，Host 看到的都是一次访问
+    void relocation_slot();
+    // dummy_access 的主体，调用方持有 storage_mutex
+    void read_random_path();
+    // 访问结束后的驱逐轮次与重排，后台模式下排队执行
+    bool eviction_deferred() const;
+    void finish_access(int leaf);
+    void schedule_eviction(bool evict_path, int leaf);
 
     // SGX 存储访问方法
     bucket sgx_read_bucket(int position);
     void sgx_write_bucket(int position, const bucket& bkt);
+    // 整条路径批量读写，path[i] 为第 i 层的桶；wanted[i] 为 0 的层不读取，dirty[i] 为 false 的层不写回
+    bool path_batch_supported() const;
+    void sgx_read_path_buckets(int leaf, vector<bucket>& path, const vector<uint8_t>& wanted);
+    void sgx_write_path_buckets(int leaf, const vector<bucket>& path, const vector<bool>& dirty);
+    // 任意一组桶（相对 tree_base 的位置）批量读写，数量受暂存区槽数限制
+    void sgx_read_buckets(const vector<int>& positions, vector<bucket>& buckets);
+    void sgx_write_buckets(const vector<int>& positions, const vector<bucket>& buckets);
     std::vector<uint8_t> serialize_bucket(const bucket& bkt);
+    size_t serialize_bucket_to(const bucket& bkt, uint8_t* out, size_t max_size) const;
     bucket deserialize_bucket(const uint8_t* data, size_t size);
+
+    // 桶元数据（count、ptrs、valids 及各槽位块的叶子）单独加密存放在 Host
+    // 加密后写入 out（容量至少 MAX_BUCKET_METADATA_SIZE），返回写入的字节数。
+    // AAD 为 (tree_base + position, 写回次数)：加密时用下一个写回次数，Host 确认写入后由 commit_metadata 递增；
+    // 解密时用当前写回次数，Host 换桶或回放旧元数据都会认证失败
+    size_t encrypt_metadata(int position, const bucket& bkt, uint8_t* out);
+    void decrypt_metadata(int position, const uint8_t* data, size_t size, bucket& bkt);
+    void apply_metadata(int position, bucket& bkt, const uint8_t* data, size_t size);
+    void commit_metadata(int position);
     
     // 序列化工具方法
     size_t calculate_bucket_size(const bucket& bkt) const;
     void serialize_block(const block& blk, uint8_t* buffer, size_t& offset) const;
-    block deserialize_block(const uint8_t* data, size_t& offset);
+    // 桶数据来自 Host，解析时校验每个长度字段不越过 size，非法时抛出 runtime_error
+    block deserialize_block(const uint8_t* data, size_t size, size_t& offset);
 };
 
@@ -0,0 +1,98 @@
+#include "SGXEnclave_t.h"
+#include "sequencer.h"
+#include <unordered_map>
+#include <stdexcept>
+
+OramSequencer::OramSequencer(ringoram& oram)
+    : oram(oram), combining(false), counters{0, 0, 0} {
+}
+
+vector<char> OramSequencer::access(int blockindex, ringoram::Operation op, const vector<char>& data)
+{
+    Request req{blockindex, op, &data, {}, false, false, {}};
+
+    std::unique_lock<std::mutex> lock(mutex);
+    pending.push_back(&req);
+    counters.requests++;
+
+    while (!req.done) {
+        if (combining) {
+            done_cv.wait(lock);
+            continue;
+        }
+
+        // 成为合并者：取走当前排队的请求，在锁外执行
+        combining = true;
+        vector<Request*> batch;
+        batch.swap(pending);
+        counters.batches++;
+        lock.unlock();
+
+        string error;
+        bool failed = false;
+        try {
+            run_batch(batch);
+        } catch (const std::exception& e) {
+            failed = true;
+            error = e.what();
+        }
+
+        lock.lock();
+        for (Request* r : batch) {
+            if (failed && !r->done) {
+                r->failed = true;
+                r->error = error;
+            }
+            r->done = true;
+        }
+        combining = false;
+        done_cv.notify_all();
+    }
+
+    if (req.failed) {
+        throw std::runtime_error(req.error);
+    }
+    return std::move(req.result);
+}
+
+OramSequencer::Stats OramSequencer::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void OramSequencer::run_batch(vector<Request*>& batch)
+{
+    // 按块号分组，组内保持到达顺序
+    unordered_map<int, size_t> group_of;
+    vector<vector<Request*>> groups;
+    for (Request* r : batch) {
+        auto it = group_of.find(r->blockindex);
+        if (it == group_of.end()) {
+            group_of.emplace(r->blockindex, groups.size());
+            groups.push_back({r});
+        } else {
+            groups[it->second].push_back(r);
+        }
+    }
+
+    // 每组一次真实访问，整批走 update_batch 共享路径上的桶；组内请求依次作用于块数据
+    vector<int> blockindices;
+    size_t merged = 0;
+    for (auto& group : groups) {
+        blockindices.push_back(group.front()->blockindex);
+        merged += group.size() - 1;
+    }
+    // 被合并的请求各补一次伪访问，与真实请求在同一次 update_batch 中读取，Host 看到的批次形状只取决于请求数
+    oram.update_batch(blockindices, [&groups](size_t i, vector<char>& blockdata) {
+        for (Request* r : groups[i]) {
+            if (r->op == ringoram::WRITE) {
+                blockdata = *r->data;
+            }
+            r->result = blockdata;
+        }
+    }, merged);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.merged += merged;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "ringoram.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+using namespace std;
+
+// 多客户端 ORAM 前端（TaORAM/ObliviStore 风格的请求定序器）
+// 任意多个 Enclave 线程并发调用 access：第一个到达的线程成为合并者，取走当前排队的所有请求组成一批，
+// 其余线程等待结果。整批经 ringoram::update_batch 执行，批内同一块号的请求合并为一次真实访问，按到达顺序依次作用于块数据
+// （读请求看到它之前的写），被合并掉的请求各补一次伪访问，伪访问与真实访问在同一次批量读取中进行，
+// Host 看到的 OCALL 与请求各不相同时一致。
+// 合并者处理批次时新到的请求进入下一批
+class OramSequencer
+{
+public:
+    struct Stats {
+        uint64_t requests;   // 收到的请求数
+        uint64_t batches;    // 处理的批次数
+        uint64_t merged;     // 与同批同块号请求合并的请求数
+    };
+
+    explicit OramSequencer(ringoram& oram);
+
+    // 阻塞直到请求完成，返回值与 ringoram::access 相同
+    vector<char> access(int blockindex, ringoram::Operation op, const vector<char>& data);
+
+    Stats stats();
+
+private:
+    struct Request {
+        int blockindex;
+        ringoram::Operation op;
+        const vector<char>* data;
+        vector<char> result;
+        bool done;
+        bool failed;
+        string error;
+    };
+
+    ringoram& oram;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    vector<Request*> pending;
+    bool combining;
+    Stats counters;
+
+    void run_batch(vector<Request*>& batch);
+};
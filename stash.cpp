@@ -0,0 +1,115 @@
+#include "stash.h"
+
+Stash::Stash(int L)
+    : L(L), prepared_leaf(-1), by_level(L + 1)
+{
+}
+
+block* Stash::find(int blockindex)
+{
+    auto it = index.find(blockindex);
+    if (it == index.end()) return nullptr;
+    return &items[it->second];
+}
+
+bool Stash::take(int blockindex, block& out)
+{
+    auto it = index.find(blockindex);
+    if (it == index.end()) return false;
+
+    out = std::move(items[it->second]);
+    remove_at(it->second);
+    return true;
+}
+
+vector<block> Stash::take_all()
+{
+    vector<block> out;
+    out.swap(items);
+    index.clear();
+    for (auto& group : by_level) {
+        group.clear();
+    }
+    prepared_leaf = -1;
+    return out;
+}
+
+void Stash::insert(const block& blk)
+{
+    insert(block(blk));
+}
+
+void Stash::insert(block&& blk)
+{
+    if (blk.IsDummy()) return;
+
+    int blockindex = blk.GetBlockindex();
+    int leaf = blk.GetLeafid();
+    auto it = index.find(blockindex);
+    if (it != index.end()) {
+        items[it->second] = std::move(blk);
+    } else {
+        index[blockindex] = items.size();
+        items.push_back(std::move(blk));
+    }
+
+    // 已准备好的驱逐路径直接追加，无需重新分组
+    if (prepared_leaf >= 0) {
+        by_level[deepest_level(leaf, prepared_leaf)].push_back(blockindex);
+    }
+}
+
+// 块的叶子与驱逐路径叶子的公共前缀长度，即块在该路径上能放置的最深层
+int Stash::deepest_level(int block_leaf, int leaf) const
+{
+    unsigned int diff = static_cast<unsigned int>(block_leaf ^ leaf);
+    if (block_leaf < 0 || diff == 0) return block_leaf < 0 ? 0 : L;
+
+    int bits = 32 - __builtin_clz(diff);
+    return bits > L ? 0 : L - bits;
+}
+
+void Stash::prepare_path(int leaf)
+{
+    for (auto& ids : by_level) {
+        ids.clear();
+    }
+    for (const auto& blk : items) {
+        by_level[deepest_level(blk.GetLeafid(), leaf)].push_back(blk.GetBlockindex());
+    }
+    prepared_leaf = leaf;
+}
+
+void Stash::take_for_level(int leaf, int level, size_t max_blocks, vector<block>& out)
+{
+    if (prepared_leaf != leaf) {
+        prepare_path(leaf);
+    }
+
+    for (int d = level; d <= L && out.size() < max_blocks; d++) {
+        vector<int>& ids = by_level[d];
+        while (!ids.empty() && out.size() < max_blocks) {
+            int id = ids.back();
+            ids.pop_back();
+
+            // 跳过已被取出、或重新放入后叶子已改变的过期项
+            auto it = index.find(id);
+            if (it == index.end()) continue;
+            if (deepest_level(items[it->second].GetLeafid(), leaf) != d) continue;
+
+            out.push_back(std::move(items[it->second]));
+            remove_at(it->second);
+        }
+    }
+}
+
+// 与末尾元素交换后弹出，保持 O(1) 删除
+void Stash::remove_at(size_t pos)
+{
+    index.erase(items[pos].GetBlockindex());
+    if (pos + 1 != items.size()) {
+        items[pos] = std::move(items.back());
+        index[items[pos].GetBlockindex()] = pos;
+    }
+    items.pop_back();
+}
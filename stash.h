@@ -0,0 +1,45 @@
+#pragma once
+#include "block.h"
+#include <vector>
+#include <cstddef>
+#include <unordered_map>
+
+using namespace std;
+
+// Ring ORAM 的 stash：按块号哈希索引，并按“在当前驱逐路径上可放置的最深层”分组
+class Stash
+{
+public:
+    explicit Stash(int L = 0);
+
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    const vector<block>& blocks() const { return items; }
+
+    // 按块号查找，不存在时返回 nullptr
+    block* find(int blockindex);
+    // 按块号取出并移除，不存在时返回 false
+    bool take(int blockindex, block& out);
+    // 放入一个块；同号的块已存在时覆盖，dummy 块直接丢弃。右值版本直接移入数据
+    void insert(const block& blk);
+    void insert(block&& blk);
+    // 取出所有块并清空 stash
+    vector<block> take_all();
+
+    // 以 leaf 的路径为驱逐路径，为第 level 层的桶取出至多 max_blocks 个可放置的块
+    // 优先取最深可放置层恰为 level 的块，把更深的块留给更深的桶
+    void take_for_level(int leaf, int level, size_t max_blocks, vector<block>& out);
+
+private:
+    int L;
+    vector<block> items;
+    unordered_map<int, size_t> index;  // 块号 -> items 中的位置
+
+    // 当前驱逐路径的分组：by_level[d] 为最深可放置层为 d 的块号（可能含已取出的过期项）
+    int prepared_leaf;
+    vector<vector<int>> by_level;
+
+    int deepest_level(int block_leaf, int leaf) const;
+    void prepare_path(int leaf);
+    void remove_at(size_t pos);
+};
@@ -12,11 +12,17 @@ void testWithQueryFileSGX(const std::string& query_filename, bool show_details =
    
     // 初始化 SGX Enclave
     SGXEnclaveWrapper enclave;
-    if (!enclave.initializeEnclave()) {
+    if (!enclave.initializeEnclave("enclave.signed.so", switchlessWorkers)) {
         std::cerr << "Failed to initialize SGX enclave" << std::endl;
         return;
     }
 
+    // Enclave 内的 ORAM 存储自检（批量装载、各位置图、整桶密封），测试树与主树使用互不重叠的存储
+    if (!enclave.testRingOramStorage()) {
+        std::cerr << "RingOramStorage self-test failed in SGX" << std::endl;
+        return;
+    }
+
     // 初始化 IRTree
     if (!enclave.initializeIRTree(2, 2, 5)) {
         std::cerr << "Failed to initialize IRTree in SGX" << std::endl;